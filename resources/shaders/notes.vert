@@ -1,8 +1,10 @@
 #version 330
+#define SETS_COUNT 12
+#define MAX_TRACK_COUNT 4096
 
 layout(location = 0) in vec2 v;
 layout(location = 1) in vec4 id; //note id, start, duration, is minor
-layout(location = 2) in float channel; //note id, start, duration, is minor
+layout(location = 2) in uint attributes; //key, channel, list set, track
 
 uniform float time;
 uniform float mainSpeed;
@@ -18,6 +20,12 @@ vec2 flipIfNeeded(vec2 inPos){
 uniform int minNoteMajor;
 uniform float notesCount;
 
+uniform int setMode;
+// Packed by four, see Renderer::upload.
+uniform ivec4 keySets[32];
+uniform int hiddenChannels;
+uniform ivec4 hiddenTracks[MAX_TRACK_COUNT / 128];
+
 out INTERFACE {
 	vec2 uv;
 	vec2 noteSize;
@@ -39,7 +47,35 @@ float minorShift(int id){
    return 0.0;
 }
 
+int noteSet(int key, int channel, int track, int listSet){
+	// Same as SetOptions::apply, key based modes use a lookup table.
+	if(setMode == 0){ // CHANNEL
+		return channel % SETS_COUNT;
+	}
+	if(setMode == 1){ // TRACK
+		return track % SETS_COUNT;
+	}
+	if(setMode == 4){ // LIST
+		return listSet;
+	}
+	return keySets[key / 4][key % 4];
+}
+
 void main(){
+
+	int key = int(attributes & 0x7Fu);
+	int channel = int((attributes >> 7u) & 0xFu);
+	int listSet = int((attributes >> 11u) & 0xFu);
+	int track = int(attributes >> 15u);
+
+	// Hidden notes are moved outside of the clip volume.
+	// Tracks past MAX_TRACK_COUNT can't be hidden, see FilterOptions.
+	int trackWord = track / 32;
+	bool hiddenTrack = track < MAX_TRACK_COUNT && ((hiddenTracks[trackWord / 4][trackWord % 4] >> (track % 32)) & 1) != 0;
+	if(((hiddenChannels >> channel) & 1) != 0 || hiddenTrack){
+		gl_Position = vec4(0.0, 0.0, 2.0, 1.0);
+		return;
+	}
 	
 	float scalingFactor = id.w != 0.0 ? minorsWidth : 1.0;
 	// Size of the note : width, height based on duration and current speed.
@@ -66,7 +102,7 @@ void main(){
 	// Scale uv.
 	Out.uv = Out.noteSize * v;
 	Out.isMinor = id.w;
-	Out.channel = channel;
+	Out.channel = float(noteSet(key, channel, track, listSet));
 
 	// Output position.
 	gl_Position = vec4(flipIfNeeded(Out.noteSize * v + noteShift), 0.0 , 1.0);
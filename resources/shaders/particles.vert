@@ -2,8 +2,9 @@
 #define SETS_COUNT 12
 
 layout(location = 0) in vec2 v;
+layout(location = 1) in vec2 system; // elapsed time, duration
+layout(location = 2) in ivec2 systemIds; // note id, set
 
-uniform float time;
 uniform float scale;
 uniform vec3 baseColor[SETS_COUNT];
 uniform vec2 inverseScreenSize;
@@ -11,9 +12,7 @@ uniform sampler2D textureParticles;
 uniform vec2 inverseTextureSize;
 uniform sampler2D textureNoise;
 
-uniform int globalId;
-uniform float duration;
-uniform int channel;
+uniform int particlesPerSystem;
 
 uniform int texCount;
 uniform float colorScale;
@@ -50,7 +49,14 @@ float rand(vec2 co){
 
 
 void main(){
-	Out.id = float(gl_InstanceID % texCount);
+	// Instances are grouped by system.
+	int particleInstance = gl_InstanceID % particlesPerSystem;
+	float time = system.x;
+	float duration = system.y;
+	int globalId = systemIds.x;
+	int channel = systemIds.y;
+
+	Out.id = float(particleInstance % texCount);
 	Out.uv = v + 0.5;
 	// Fade color based on time.
 	Out.color = vec4(colorScale * baseColor[channel], 1.0-time*time);
@@ -59,7 +65,7 @@ void main(){
 	float particlesCount = 1.0/inverseTextureSize.y;
 	
 	// Pick particle id at random.
-	float particleId = float(gl_InstanceID) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
+	float particleId = float(particleInstance) + floor(particlesCount * 10.0 * rand(vec2(globalId,globalId)));
 	float textureId = mod(particleId,particlesCount);
 	float particleShift = floor(particleId/particlesCount);
 	
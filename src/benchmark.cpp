@@ -0,0 +1,498 @@
+// Benchmark of MIDI files loading, on synthetic files or files from disk.
+// Only depends on the MIDI sources, no window or GPU is required.
+
+#include "midi/MIDIFile.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#undef APIENTRY
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
+// Synthetic files use this resolution and start at 120 BPM, so 960 ticks per second.
+#define BENCH_UNITS_PER_QUARTER_NOTE 480
+#define BENCH_INITIAL_TEMPO 500000
+#define BENCH_TICKS_PER_SECOND 960
+
+// Parameters of a synthetic file.
+struct GeneratorSettings {
+	std::string name = "custom";
+	unsigned int tracks = 16;
+	double duration = 120.0; ///< In seconds, at the initial tempo.
+	double notesPerSecond = 200.0; ///< Over all tracks.
+	double tempoChangesPerMinute = 10.0;
+	double noisePerSecond = 5.0; ///< Meta, sysex and controller events ignored when extracting notes, over all tracks.
+	double pedalsPerSecond = 1.0; ///< Pedal presses over all tracks.
+	bool runningStatus = true;
+	uint64_t seed = 1;
+};
+
+// Pseudo-random generator giving the same sequence on all platforms (xorshift64*).
+class Random {
+public:
+
+	Random(uint64_t seed) : _state(seed * 0x9E3779B97F4A7C15ull + 1) {}
+
+	uint64_t next(){
+		_state ^= _state >> 12;
+		_state ^= _state << 25;
+		_state ^= _state >> 27;
+		return _state * 0x2545F4914F6CDD1Dull;
+	}
+
+	/// Integer in [0, count).
+	uint32_t range(uint32_t count){
+		return uint32_t(((next() >> 32) * uint64_t(count)) >> 32);
+	}
+
+	/// Integer in [a, b].
+	uint32_t range(uint32_t a, uint32_t b){
+		return a + range(b - a + 1);
+	}
+
+private:
+	uint64_t _state;
+};
+
+// Events of a track, encoded once sorted.
+class TrackBuilder {
+public:
+
+	/// Channel message, its status byte can be omitted with running status.
+	void message(uint32_t tick, uint8_t status, uint8_t data0, uint8_t data1, bool hasData1 = true){
+		push(tick, 1, {status, data0, data1}, hasData1 ? 3 : 2);
+	}
+
+	/// Note offs are sorted before other events at the same tick.
+	void noteOff(uint32_t tick, uint8_t channel, uint8_t key, bool useNoteOn){
+		push(tick, 0, {uint8_t((useNoteOn ? 0x90 : 0x80) | channel), key, 0}, 3);
+	}
+
+	void meta(uint32_t tick, uint8_t type, const std::vector<uint8_t> & data){
+		addRaw(tick, {0xFF, type}, data);
+	}
+
+	void sysex(uint32_t tick, const std::vector<uint8_t> & data){
+		std::vector<uint8_t> payload(data);
+		payload.push_back(0xF7);
+		addRaw(tick, {0xF0}, payload);
+	}
+
+	/// Append the encoded chunk to the output.
+	void write(std::vector<uint8_t> & output, bool runningStatus){
+		std::stable_sort(_events.begin(), _events.end(), [](const Event & a, const Event & b){
+			return a.tick < b.tick || (a.tick == b.tick && a.priority < b.priority);
+		});
+		std::vector<uint8_t> data;
+		uint32_t previousTick = 0;
+		uint8_t previousStatus = 0;
+		for(const Event & event : _events){
+			writeVarLen(data, event.tick - previousTick);
+			previousTick = event.tick;
+			const uint8_t* bytes = &_bytes[event.offset];
+			const uint8_t status = bytes[0];
+			if(status < 0xF0){
+				if(!(runningStatus && status == previousStatus)){
+					data.push_back(status);
+				}
+				previousStatus = status;
+			} else {
+				// Meta and sysex events cancel running status.
+				data.push_back(status);
+				previousStatus = 0;
+			}
+			data.insert(data.end(), bytes + 1, bytes + event.length);
+		}
+		// End of track.
+		data.insert(data.end(), {0x00, 0xFF, 0x2F, 0x00});
+
+		output.insert(output.end(), {'M', 'T', 'r', 'k'});
+		writeBig(output, uint32_t(data.size()), 4);
+		output.insert(output.end(), data.begin(), data.end());
+	}
+
+	static void writeVarLen(std::vector<uint8_t> & data, uint32_t value){
+		uint8_t bytes[5];
+		int count = 0;
+		bytes[count++] = value & 0x7F;
+		while(value >>= 7){
+			bytes[count++] = uint8_t((value & 0x7F) | 0x80);
+		}
+		while(count > 0){
+			data.push_back(bytes[--count]);
+		}
+	}
+
+	static void writeBig(std::vector<uint8_t> & data, uint32_t value, int size){
+		for(int i = size - 1; i >= 0; --i){
+			data.push_back(uint8_t((value >> (8 * i)) & 0xFF));
+		}
+	}
+
+private:
+
+	struct Event {
+		uint32_t tick;
+		uint32_t priority;
+		size_t offset;
+		uint32_t length;
+	};
+
+	void push(uint32_t tick, uint32_t priority, const std::array<uint8_t, 3> & bytes, uint32_t length){
+		_events.push_back({tick, priority, _bytes.size(), length});
+		_bytes.insert(_bytes.end(), bytes.begin(), bytes.begin() + length);
+	}
+
+	void addRaw(uint32_t tick, const std::vector<uint8_t> & prefix, const std::vector<uint8_t> & data){
+		const size_t offset = _bytes.size();
+		_bytes.insert(_bytes.end(), prefix.begin(), prefix.end());
+		writeVarLen(_bytes, uint32_t(data.size()));
+		_bytes.insert(_bytes.end(), data.begin(), data.end());
+		_events.push_back({tick, 1, offset, uint32_t(_bytes.size() - offset)});
+	}
+
+	std::vector<Event> _events;
+	std::vector<uint8_t> _bytes;
+};
+
+/// Spread a total count over tracks, the first tracks receiving the remainder.
+size_t countForTrack(double total, unsigned int trackId, unsigned int trackCount){
+	const size_t count = size_t(total);
+	return count / trackCount + (trackId < count % trackCount ? 1 : 0);
+}
+
+void addNoise(TrackBuilder & track, Random & random, uint32_t ticks, uint8_t channel){
+	const uint32_t tick = random.range(ticks);
+	switch(random.range(5)){
+		case 0: {
+			const std::string text = "Noise " + std::to_string(random.range(1000));
+			track.meta(tick, random.range(2) ? 0x01 : 0x06, std::vector<uint8_t>(text.begin(), text.end()));
+			break;
+		}
+		case 1: {
+			std::vector<uint8_t> data(random.range(4, 32));
+			for(uint8_t & byte : data){
+				byte = uint8_t(random.range(128));
+			}
+			track.sysex(tick, data);
+			break;
+		}
+		case 2:
+			// Volume or pan.
+			track.message(tick, uint8_t(0xB0 | channel), random.range(2) ? 7 : 10, uint8_t(random.range(128)));
+			break;
+		case 3:
+			track.message(tick, uint8_t(0xC0 | channel), uint8_t(random.range(128)), 0, false);
+			break;
+		default:
+			track.message(tick, uint8_t(0xE0 | channel), uint8_t(random.range(128)), uint8_t(random.range(128)));
+			break;
+	}
+}
+
+/// Generate a format 1 file, with a tempo track followed by note tracks.
+std::vector<uint8_t> generateFile(const GeneratorSettings & settings){
+	Random random(settings.seed);
+	const uint32_t ticks = (std::max)(uint32_t(settings.duration * BENCH_TICKS_PER_SECOND), 1u);
+	const unsigned int trackCount = (std::max)(settings.tracks, 1u);
+
+	std::vector<uint8_t> output = {'M', 'T', 'h', 'd', 0, 0, 0, 6, 0, 1};
+	TrackBuilder::writeBig(output, trackCount + 1, 2);
+	TrackBuilder::writeBig(output, BENCH_UNITS_PER_QUARTER_NOTE, 2);
+
+	// Tempo track.
+	{
+		TrackBuilder track;
+		const std::string name = "Tempo";
+		track.meta(0, 0x03, std::vector<uint8_t>(name.begin(), name.end()));
+		track.meta(0, 0x58, {4, 2, 24, 8});
+		track.meta(0, 0x51, {(BENCH_INITIAL_TEMPO >> 16) & 0xFF, (BENCH_INITIAL_TEMPO >> 8) & 0xFF, BENCH_INITIAL_TEMPO & 0xFF});
+		const size_t tempoCount = size_t(settings.tempoChangesPerMinute * settings.duration / 60.0);
+		for(size_t tid = 0; tid < tempoCount; ++tid){
+			const uint32_t tempo = random.range(300000, 900000);
+			track.meta(random.range(ticks), 0x51, {uint8_t(tempo >> 16), uint8_t(tempo >> 8), uint8_t(tempo)});
+		}
+		track.write(output, settings.runningStatus);
+	}
+
+	const uint8_t pedalTypes[] = {64, 64, 64, 66, 67, 11};
+	for(unsigned int trackId = 0; trackId < trackCount; ++trackId){
+		TrackBuilder track;
+		const uint8_t channel = uint8_t(trackId % 16);
+		const std::string name = "Track " + std::to_string(trackId);
+		track.meta(0, 0x03, std::vector<uint8_t>(name.begin(), name.end()));
+		track.message(0, uint8_t(0xC0 | channel), 0, 0, false);
+
+		const size_t noteCount = countForTrack(settings.notesPerSecond * settings.duration, trackId, trackCount);
+		for(size_t nid = 0; nid < noteCount; ++nid){
+			const uint32_t start = random.range(ticks);
+			const uint32_t length = random.range(BENCH_TICKS_PER_SECOND / 20, 2 * BENCH_TICKS_PER_SECOND);
+			const uint8_t key = uint8_t(random.range(21, 108));
+			track.message(start, uint8_t(0x90 | channel), key, uint8_t(random.range(1, 127)));
+			track.noteOff(start + length, channel, key, random.range(2) == 0);
+		}
+
+		const size_t pedalCount = countForTrack(settings.pedalsPerSecond * settings.duration, trackId, trackCount);
+		for(size_t pid = 0; pid < pedalCount; ++pid){
+			const uint32_t start = random.range(ticks);
+			const uint32_t length = random.range(BENCH_TICKS_PER_SECOND / 4, 4 * BENCH_TICKS_PER_SECOND);
+			const uint8_t type = pedalTypes[random.range(6)];
+			track.message(start, uint8_t(0xB0 | channel), type, uint8_t(random.range(64, 127)));
+			track.message(start + length, uint8_t(0xB0 | channel), type, 0);
+		}
+
+		const size_t noiseCount = countForTrack(settings.noisePerSecond * settings.duration, trackId, trackCount);
+		for(size_t eid = 0; eid < noiseCount; ++eid){
+			addNoise(track, random, ticks, channel);
+		}
+		track.write(output, settings.runningStatus);
+	}
+	return output;
+}
+
+/// Highest memory usage of the process so far, in kilobytes.
+size_t peakMemory(){
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if(GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))){
+		return size_t(counters.PeakWorkingSetSize / 1024);
+	}
+	return 0;
+#else
+	struct rusage usage;
+	if(getrusage(RUSAGE_SELF, &usage) != 0){
+		return 0;
+	}
+#ifdef __APPLE__
+	// In bytes on macOS.
+	return size_t(usage.ru_maxrss / 1024);
+#else
+	return size_t(usage.ru_maxrss);
+#endif
+#endif
+}
+
+/// Reset the peak memory usage when supported (Linux only), so that each case is measured separately.
+void resetPeakMemory(){
+#if defined(__linux__)
+	std::ofstream clearRefs("/proc/self/clear_refs");
+	if(clearRefs.is_open()){
+		clearRefs << "5";
+	}
+#endif
+}
+
+struct BenchResult {
+	std::string name;
+	size_t fileSize = 0;
+	int tracks = 0;
+	int notes = 0;
+	unsigned int runs = 0;
+	MIDILoadStats stats; ///< Of the median run.
+	double total = 0.0; ///< Of the median run, in milliseconds.
+	size_t peakMemory = 0; ///< In kilobytes.
+};
+
+/// Load a file several times and keep the median run, return false if the file is invalid.
+bool benchFile(const std::string & path, const std::string & name, const MIDILoadOptions & options, unsigned int runs, BenchResult & result){
+	result.name = name;
+	result.runs = runs;
+	{
+		std::ifstream file(path, std::ios::binary | std::ios::ate);
+		result.fileSize = file.is_open() ? size_t(file.tellg()) : 0;
+	}
+	resetPeakMemory();
+
+	std::vector<std::pair<double, MIDILoadStats>> samples;
+	// Silence per-track logs while loading.
+	std::stringstream logs;
+	std::streambuf* coutBuffer = std::cout.rdbuf(logs.rdbuf());
+	try {
+		for(unsigned int rid = 0; rid < runs; ++rid){
+			const auto start = std::chrono::steady_clock::now();
+			MIDIFile file(path, options);
+			const auto end = std::chrono::steady_clock::now();
+			samples.emplace_back(std::chrono::duration<double, std::milli>(end - start).count(), file.loadStats());
+			result.tracks = file.tracksCount();
+			result.notes = file.notesCount();
+			logs.str("");
+		}
+	} catch(...){
+		std::cout.rdbuf(coutBuffer);
+		std::cerr << "[ERROR]: Unable to load " << path << std::endl;
+		return false;
+	}
+	std::cout.rdbuf(coutBuffer);
+
+	std::sort(samples.begin(), samples.end(), [](const std::pair<double, MIDILoadStats> & a, const std::pair<double, MIDILoadStats> & b){
+		return a.first < b.first;
+	});
+	const auto & median = samples[samples.size() / 2];
+	result.total = median.first;
+	result.stats = median.second;
+	result.peakMemory = peakMemory();
+	return true;
+}
+
+/// Files covering typical and extreme cases, used when no generator settings are given.
+std::vector<GeneratorSettings> defaultSuite(){
+	std::vector<GeneratorSettings> suite(5);
+	suite[0].name = "piano";
+	suite[0].tracks = 2; suite[0].duration = 240.0; suite[0].notesPerSecond = 20.0; suite[0].pedalsPerSecond = 0.5;
+	suite[1].name = "orchestral";
+	suite[1].tracks = 300; suite[1].duration = 600.0; suite[1].notesPerSecond = 400.0; suite[1].noisePerSecond = 50.0;
+	suite[2].name = "dense";
+	suite[2].tracks = 16; suite[2].duration = 300.0; suite[2].notesPerSecond = 5000.0;
+	suite[3].name = "noisy";
+	suite[3].tracks = 16; suite[3].noisePerSecond = 1000.0; suite[3].pedalsPerSecond = 50.0; suite[3].runningStatus = false;
+	suite[4].name = "tempos";
+	suite[4].tracks = 8; suite[4].duration = 300.0; suite[4].notesPerSecond = 500.0; suite[4].tempoChangesPerMinute = 600.0;
+	return suite;
+}
+
+void printHelp(){
+	std::cout << "MIDIVisualizerBench: measure MIDI files loading performance." << std::endl
+	<< "Without any generator option, a suite of synthetic files is used." << std::endl << std::endl
+	<< "* Generator options:" << std::endl
+	<< "--tracks N               number of note tracks (default 16)" << std::endl
+	<< "--duration S             duration in seconds (default 120)" << std::endl
+	<< "--notes-per-second N     notes over all tracks (default 200)" << std::endl
+	<< "--tempo-changes N        tempo changes per minute (default 10)" << std::endl
+	<< "--noise N                meta, sysex and controller events per second (default 5)" << std::endl
+	<< "--pedals N               pedal presses per second (default 1)" << std::endl
+	<< "--running-status 0/1     omit repeated status bytes (default 1)" << std::endl
+	<< "--seed N                 random seed (default 1)" << std::endl
+	<< "--keep                   keep generated files in the working directory" << std::endl << std::endl
+	<< "* Bench options:" << std::endl
+	<< "--file path              load an existing file instead of generating one" << std::endl
+	<< "--runs N                 loads per file, the median is reported (default 3)" << std::endl
+	<< "--threads N              loading threads, 0 for all cores (default 0)" << std::endl
+	<< "--full-decode            decode all events instead of only those used for display" << std::endl
+	<< "--output path            write results as CSV" << std::endl;
+}
+
+int main(int argc, char** argv){
+	GeneratorSettings custom;
+	bool useCustom = false;
+	bool keepFiles = false;
+	std::vector<std::string> files;
+	std::string outputPath;
+	unsigned int runs = 3;
+	MIDILoadOptions options;
+	options.releaseEvents = true;
+	options.selectiveDecode = true;
+
+	for(int aid = 1; aid < argc; ++aid){
+		const std::string arg = argv[aid];
+		const bool hasValue = aid + 1 < argc;
+		const std::string value = hasValue ? argv[aid + 1] : "";
+		try {
+			if(arg == "--help" || arg == "-h"){
+				printHelp();
+				return 0;
+			} else if(arg == "--keep"){
+				keepFiles = true;
+				continue;
+			} else if(arg == "--full-decode"){
+				options.selectiveDecode = false;
+				continue;
+			}
+			if(!hasValue){
+				std::cerr << "[ERROR]: Missing value for " << arg << std::endl;
+				return 1;
+			}
+			++aid;
+			if(arg == "--tracks"){
+				custom.tracks = (unsigned int)std::stoul(value); useCustom = true;
+			} else if(arg == "--duration"){
+				custom.duration = std::stod(value); useCustom = true;
+			} else if(arg == "--notes-per-second"){
+				custom.notesPerSecond = std::stod(value); useCustom = true;
+			} else if(arg == "--tempo-changes"){
+				custom.tempoChangesPerMinute = std::stod(value); useCustom = true;
+			} else if(arg == "--noise"){
+				custom.noisePerSecond = std::stod(value); useCustom = true;
+			} else if(arg == "--pedals"){
+				custom.pedalsPerSecond = std::stod(value); useCustom = true;
+			} else if(arg == "--running-status"){
+				custom.runningStatus = value == "1" || value == "true"; useCustom = true;
+			} else if(arg == "--seed"){
+				custom.seed = std::stoull(value); useCustom = true;
+			} else if(arg == "--file"){
+				files.push_back(value);
+			} else if(arg == "--runs"){
+				runs = (std::max)(1u, (unsigned int)std::stoul(value));
+			} else if(arg == "--threads"){
+				options.threadCount = (unsigned int)std::stoul(value);
+			} else if(arg == "--output"){
+				outputPath = value;
+			} else {
+				std::cerr << "[WARNING]: Unknown option " << arg << std::endl;
+			}
+		} catch(...){
+			std::cerr << "[ERROR]: Invalid value " << value << " for " << arg << std::endl;
+			return 1;
+		}
+	}
+
+	std::vector<BenchResult> results;
+	for(const std::string & path : files){
+		BenchResult result;
+		if(benchFile(path, path, options, runs, result)){
+			results.push_back(result);
+		}
+	}
+	if(files.empty() || useCustom){
+		const std::vector<GeneratorSettings> suite = useCustom ? std::vector<GeneratorSettings>(1, custom) : defaultSuite();
+		for(const GeneratorSettings & settings : suite){
+			const std::string path = "bench_" + settings.name + ".mid";
+			{
+				const std::vector<uint8_t> data = generateFile(settings);
+				std::ofstream file(path, std::ios::binary | std::ios::trunc);
+				file.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+			}
+			BenchResult result;
+			if(benchFile(path, settings.name, options, runs, result)){
+				results.push_back(result);
+			}
+			if(!keepFiles){
+				std::remove(path.c_str());
+			}
+		}
+	}
+
+	std::stringstream csv;
+	csv << "name,file_bytes,tracks,notes,threads,runs,read_ms,cache_ms,read_tracks_ms,tempos_ms,extract_notes_ms,merge_tracks_ms,finalize_ms,total_ms,notes_per_second,peak_memory_kb\n";
+	for(const BenchResult & result : results){
+		const double notesPerSecond = result.total > 0.0 ? double(result.notes) / (result.total / 1000.0) : 0.0;
+		const MIDILoadStats & stats = result.stats;
+		std::cout << "[BENCH]: " << result.name << ": " << result.notes << " notes, " << result.tracks << " tracks, "
+			<< result.total << "ms (read " << stats.reading << "ms, tracks " << stats.decoding << "ms, tempos " << stats.tempos
+			<< "ms, notes " << stats.notes << "ms, merge " << stats.merging << "ms, finalize " << stats.finalizing << "ms), "
+			<< size_t(notesPerSecond) << " notes/s, peak " << result.peakMemory / 1024 << "MB." << std::endl;
+		csv << result.name << "," << result.fileSize << "," << result.tracks << "," << result.notes << "," << stats.threadCount << "," << result.runs << ","
+			<< stats.reading << "," << stats.cache << "," << stats.decoding << "," << stats.tempos << "," << stats.notes << "," << stats.merging << "," << stats.finalizing << ","
+			<< result.total << "," << notesPerSecond << "," << result.peakMemory << "\n";
+	}
+	if(!outputPath.empty()){
+		std::ofstream output(outputPath, std::ios::trunc);
+		if(!output.is_open()){
+			std::cerr << "[ERROR]: Unable to write results to " << outputPath << std::endl;
+			return 1;
+		}
+		output << csv.str();
+	}
+	return results.empty() ? 1 : 0;
+}
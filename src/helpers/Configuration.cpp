@@ -109,6 +109,36 @@ Configuration::Configuration(const std::string& path, const std::vector<std::str
 				lastMidiDevice = join(vals, " ");
 			}
 		}
+		// Cache options
+		{
+			if(name == "scene-cache"){
+				useCache = vals.empty() || Configuration::parseBool(vals[0]);
+			}
+			if(name == "prewarm-cache" && vals.size() >= 1){
+				prewarmPath = join(vals, " ");
+			}
+		}
+		// Live options
+		{
+			if(name == "recover-live"){
+				recoverLive = true;
+			}
+			if(name == "live-replay" && vals.size() >= 1){
+				liveReplayPath = join(vals, " ");
+			}
+			if(name == "live-replay-speed" && vals.size() >= 1){
+				liveReplaySpeed = Configuration::parseFloat(vals[0]);
+			}
+			if(name == "live-stress" && vals.size() >= 1){
+				liveStressRate = Configuration::parseFloat(vals[0]);
+			}
+			if(name == "live-duration" && vals.size() >= 1){
+				liveDuration = Configuration::parseFloat(vals[0]);
+			}
+			if(name == "live-report" && vals.size() >= 1){
+				liveReportPath = join(vals, " ");
+			}
+		}
 		// Export options
 		{
 			if(name == "export" && vals.size() >= 1){
@@ -276,6 +306,14 @@ void Configuration::printHelp(){
 		{"gui-size", "GUI text and button scaling (number, default 1.0)"},
 		{"transparency", "enable transparent window background if supported (1 or 0 to enable/disable)"},
 		{"forbid-transparency", "prevent transparent window background (1 or 0 to enable/disable)"},
+		{"scene-cache", "cache loaded MIDI files for faster reloads (1 or 0 to enable/disable, default 1)"},
+		{"prewarm-cache", "path to a directory of MIDI files to add to the cache with the current notes-pairing, then quit"},
+		{"recover-live", "convert live sessions interrupted by a crash to MIDI files, then quit"},
+		{"live-replay", "path to a MIDI file to replay as if it was played on a device"},
+		{"live-replay-speed", "replay speed factor (number, default 1.0)"},
+		{"live-stress", "start a live session receiving random notes and pedals (messages per second)"},
+		{"live-duration", "quit after this many seconds of live session and print statistics (number)"},
+		{"live-report", "path to a CSV file to write latency statistics to when quitting a timed live session"},
 		{"help", "display this help message"},
 		{"version", "display the executable version and configuration"},
 	};
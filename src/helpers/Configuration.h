@@ -76,6 +76,20 @@ public:
 	// Export settings (won't be saved)
 	Export exporting;
 
+	// Cache settings (won't be saved)
+	std::string cachePath; ///< Directory of the scene cache, empty if disabled.
+	std::string prewarmPath; ///< Directory of MIDI files to add to the cache.
+	bool useCache = true;
+
+	// Live sessions settings (won't be saved)
+	std::string journalPath; ///< Directory of the live sessions journals, empty if unavailable.
+	std::string liveReplayPath; ///< MIDI file to replay as a live session.
+	std::string liveReportPath; ///< CSV file to write latency statistics to at the end of a timed live session.
+	float liveReplaySpeed = 1.0f;
+	float liveStressRate = 0.0f; ///< Messages per second of a generated live session, 0 to disable.
+	float liveDuration = 0.0f; ///< Quit after this many seconds of live session, 0 to disable.
+	bool recoverLive = false;
+
 private:
 
 	Arguments _args;
@@ -107,6 +107,11 @@ inline void ShaderProgram::uniforms(const std::string& name, size_t count, const
 	glUniform4fv(_uniforms[name], (unsigned int)count, (GLfloat*)vals);
 }
 
+template<>
+inline void ShaderProgram::uniforms(const std::string& name, size_t count, const glm::ivec4* vals){
+	glUniform4iv(_uniforms[name], (unsigned int)count, (GLint*)vals);
+}
+
 // Texture loading.
 
 // 2D texture.
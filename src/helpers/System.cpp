@@ -15,6 +15,7 @@
 #include <shlobj.h>
 #else
 #include <sys/stat.h>
+#include <dirent.h>
 #endif
 
 #ifdef __APPLE__
@@ -84,6 +85,24 @@ bool System::createDirectory(const std::string & directory) {
 	return success;
 }
 
+std::vector<std::string> System::listFiles(const std::string & directory){
+	std::vector<std::string> files;
+	wchar_t* str = widen(directory + "\\*");
+	WIN32_FIND_DATAW entry;
+	HANDLE search = FindFirstFileW(str, &entry);
+	delete[] str;
+	if(search == INVALID_HANDLE_VALUE){
+		return files;
+	}
+	do {
+		if(!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)){
+			files.push_back(narrow(entry.cFileName));
+		}
+	} while(FindNextFileW(search, &entry) != 0);
+	FindClose(search);
+	return files;
+}
+
 std::ifstream System::openInputFile(const std::string& path, bool binary){
 	wchar_t* str = widen(path);
 	auto flags = binary ? std::ios::binary|std::ios::in : std::ios::in;
@@ -106,6 +125,23 @@ bool System::createDirectory(const std::string & directory) {
 	return mkdir(directory.c_str(), S_IRWXU | S_IRWXG | S_IRWXO) == 0;
 }
 
+std::vector<std::string> System::listFiles(const std::string & directory){
+	std::vector<std::string> files;
+	DIR* dir = opendir(directory.c_str());
+	if(dir == nullptr){
+		return files;
+	}
+	while(struct dirent* entry = readdir(dir)){
+		const std::string name(entry->d_name);
+		struct stat infos;
+		if(stat((directory + "/" + name).c_str(), &infos) == 0 && S_ISREG(infos.st_mode)){
+			files.push_back(name);
+		}
+	}
+	closedir(dir);
+	return files;
+}
+
 std::ifstream System::openInputFile(const std::string& path, bool binary){
 	auto flags = binary ? std::ios::binary|std::ios::in : std::ios::in;
 	std::ifstream file(path.c_str(), flags);
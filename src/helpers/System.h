@@ -2,6 +2,7 @@
 
 #include <fstream>
 #include <string>
+#include <vector>
 
 /**
  \brief Performs system basic operations such as directory creation, timing, threading, file picking.
@@ -38,6 +39,12 @@ public:
 		 */
 	static bool createDirectory(const std::string & directory);
 	
+	/** List the files in a directory, without recursion.
+	 \param directory the path to the directory
+	 \return the names of the files, excluding subdirectories
+	 */
+	static std::vector<std::string> listFiles(const std::string & directory);
+
 	static std::string getApplicationDataDirectory();
 
 	static void forceLocale();
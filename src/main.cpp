@@ -7,6 +7,12 @@
 #include "helpers/System.h"
 
 #include "rendering/Viewer.h"
+#include "midi/MIDIFile.h"
+#include "midi/MIDICache.h"
+#include "midi/MIDIJournal.h"
+#include "midi/MIDIBuffer.h"
+#include "midi/MIDIInputSource.h"
+#include "resources/strings.h"
 
 #include <imgui/imgui.h>
 #include <imgui/imgui_impl_glfw.h>
@@ -158,6 +164,76 @@ void logLastGlfwError(){
 	std::cerr << "[ERROR]: GLFW error: " << getGlfwErrorType(code) << " \"" << (msg ? msg : "") << "\"" << std::endl;
 }
 
+/// Extract all MIDI files in a directory to the scene cache.
+
+int prewarmCache(const Configuration & config){
+	if(config.cachePath.empty()){
+		std::cerr << "[ERROR]: The scene cache is disabled or unavailable." << std::endl;
+		return 1;
+	}
+	// Files have to be extracted with the same options as when loading them in the viewer.
+	MIDILoadOptions options;
+	options.releaseEvents = true;
+	options.selectiveDecode = true;
+	options.cacheDirectory = config.cachePath;
+	// The viewer applies the config file then the arguments.
+	options.notePairing = State::loadNotesPairing(config.lastConfigPath, config.args());
+
+	int count = 0;
+	for(const std::string & name : System::listFiles(config.prewarmPath)){
+		const std::string::size_type pos = name.rfind('.');
+		const std::string extension = pos == std::string::npos ? "" : name.substr(pos + 1);
+		if(extension != "mid" && extension != "midi"){
+			continue;
+		}
+		try {
+			MIDIFile file(config.prewarmPath + "/" + name, options);
+			++count;
+		} catch(...){
+			std::cerr << "[ERROR]: Unable to cache " << name << "." << std::endl;
+		}
+	}
+	std::cout << "[INFO]: Cached " << count << " files from " << config.prewarmPath << "." << std::endl;
+	return 0;
+}
+
+/// List the journals left by interrupted live sessions.
+
+std::vector<std::string> pendingJournals(const Configuration & config){
+	std::vector<std::string> journals;
+	if(config.journalPath.empty()){
+		return journals;
+	}
+	const std::string extension(MIDI_JOURNAL_EXTENSION);
+	for(const std::string & name : System::listFiles(config.journalPath)){
+		if(name.size() > extension.size() && name.compare(name.size() - extension.size(), extension.size(), extension) == 0){
+			journals.push_back(name.substr(0, name.size() - extension.size()));
+		}
+	}
+	return journals;
+}
+
+/// Convert the journals left by interrupted live sessions to MIDI files.
+
+int recoverLiveSessions(const Configuration & config){
+	if(config.journalPath.empty()){
+		std::cerr << "[ERROR]: The live sessions directory is unavailable." << std::endl;
+		return 1;
+	}
+	int count = 0;
+	for(const std::string & name : pendingJournals(config)){
+		const std::string journalPath = config.journalPath + name + MIDI_JOURNAL_EXTENSION;
+		const std::string outputPath = config.journalPath + name + ".mid";
+		if(MIDIJournal::recover(journalPath, outputPath)){
+			MIDIBuffer::remove(journalPath);
+			std::cout << "[INFO]: Recovered live session to " << outputPath << "." << std::endl;
+			++count;
+		}
+	}
+	std::cout << "[INFO]: Recovered " << count << " live sessions in " << config.journalPath << "." << std::endl;
+	return 0;
+}
+
 /// The main function
 int main( int argc, char** argv) {
 
@@ -203,6 +279,34 @@ int main( int argc, char** argv) {
 		sr_gui_cleanup();
 		return 0;
 	}
+
+	// Extracted MIDI files are cached along the configuration.
+	if(config.useCache && !applicationDataPath.empty()){
+		config.cachePath = applicationDataPath + "cache/";
+		System::createDirectory(config.cachePath);
+		pruneCacheDirectory(config.cachePath, System::listFiles(config.cachePath));
+	}
+	if(!config.prewarmPath.empty()){
+		const int res = prewarmCache(config);
+		glfwTerminate();
+		sr_gui_cleanup();
+		return res;
+	}
+	// Live sessions are journaled along the configuration.
+	if(!applicationDataPath.empty()){
+		config.journalPath = applicationDataPath + "live/";
+		System::createDirectory(config.journalPath);
+	}
+	if(config.recoverLive){
+		const int res = recoverLiveSessions(config);
+		glfwTerminate();
+		sr_gui_cleanup();
+		return res;
+	}
+	const size_t journalsCount = pendingJournals(config).size();
+	if(journalsCount != 0){
+		std::cout << "[INFO]: " << journalsCount << " interrupted live sessions can be recovered with --recover-live." << std::endl;
+	}
 	
 	// On OS X, the correct OpenGL profile and version to use have to be explicitely defined.
 	glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
@@ -286,6 +390,21 @@ int main( int argc, char** argv) {
 		if(!config.lastMidiDevice.empty()){
 			viewer.connectDevice(config.lastMidiDevice);
 		}
+		// Or replay a file or generate messages as if they were received live.
+		if(!config.liveReplayPath.empty()){
+			std::unique_ptr<MIDIInputSource> source;
+			try {
+				source = std::make_unique<MIDIReplaySource>(config.liveReplayPath, config.liveReplaySpeed);
+			} catch(...){
+				std::cerr << "[ERROR]: Unable to replay file at path " << config.liveReplayPath << std::endl;
+			}
+			if(source){
+				viewer.connectSource(std::move(source), true);
+			}
+		} else if(config.liveStressRate > 0.0f){
+			viewer.connectSource(std::make_unique<MIDIStressSource>(config.liveStressRate, 1), true);
+		}
+		viewer.setLiveDuration(config.liveDuration, config.liveReportPath);
 
 		// Define utility pointer for callbacks (can be obtained back from inside the callbacks).
 		glfwSetWindowUserPointer(window, &viewer);
@@ -340,6 +459,7 @@ int main( int argc, char** argv) {
 
 			//Display the result fo the current rendering loop.
 			glfwSwapBuffers(window);
+			viewer.framePresented();
 			// Update events (inputs,...).
 			glfwPollEvents();
 
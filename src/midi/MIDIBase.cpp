@@ -1,10 +1,12 @@
 #include "MIDIBase.h"
 
+#include <algorithm>
+
 MIDINote::MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId) : start(aStart), duration(aDuration), track(trackId), set(0), note(aNote), velocity(aVelocity), channel(aChannel) {
 
 }
 
-MIDIEvent::MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData) : category(aCategory), type(aType), delta(aDelta), data(aData) {
+MIDIEvent::MIDIEvent() : delta(0), payload({0, 0}), category(EventCategory::MIDI), type(0) {
 
 }
 
@@ -16,6 +18,269 @@ MIDITempo::MIDITempo(size_t astart, unsigned int atempo) : start(astart), tempo(
 	
 }
 
+TempoMap::TempoMap() : _tempos(1, MIDITempo(0, 500000)) {
+
+}
+
+TempoMap::TempoMap(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote) : _tempos(tempos), _unitsPerQuarterNote(unitsPerQuarterNote) {
+	if(_tempos.empty()){
+		_tempos.emplace_back(0, 500000);
+	}
+	// Compute the real time stamp of each tempo.
+	// We are guaranteed that there is an event at t = 0.
+	double currentTime = 0.0;
+	_tempos[0].timestamp = 0.0;
+	for(size_t tid = 1; tid < _tempos.size(); ++tid){
+		const int delta = int(_tempos[tid].start) - int(_tempos[tid-1].start);
+		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
+		_tempos[tid].timestamp = currentTime;
+	}
+}
+
+size_t TempoMap::tempoIndex(size_t units) const {
+	// Last tempo starting at or before the given time.
+	const auto next = std::upper_bound(_tempos.begin(), _tempos.end(), units, [](size_t time, const MIDITempo & tempo){
+		return time < tempo.start;
+	});
+	return next == _tempos.begin() ? 0 : size_t(next - _tempos.begin()) - 1;
+}
+
+double TempoMap::secondsAt(size_t units, size_t index) const {
+	const MIDITempo & tempo = _tempos[index];
+	const double time = tempo.timestamp + computeUnitsDuration(tempo.tempo, units - tempo.start, _unitsPerQuarterNote);
+	return time / 1000000.0;
+}
+
+double TempoMap::secondsAt(size_t units) const {
+	return secondsAt(units, tempoIndex(units));
+}
+
+void TempoMap::append(size_t start, unsigned int tempo){
+	MIDITempo & last = _tempos.back();
+	if(start == last.start){
+		last.tempo = tempo;
+		return;
+	}
+	const int delta = int(start) - int(last.start);
+	const double timestamp = last.timestamp + computeUnitsDuration(last.tempo, delta, _unitsPerQuarterNote);
+	_tempos.emplace_back(start, tempo);
+	_tempos.back().timestamp = timestamp;
+}
+
+TempoMap::Cursor::Cursor(const TempoMap & map) : _map(&map) {
+
+}
+
+double TempoMap::Cursor::secondsAt(size_t units){
+	const std::vector<MIDITempo> & tempos = _map->_tempos;
+	if(units < tempos[_index].start){
+		// Going backward, restart from scratch.
+		_index = _map->tempoIndex(units);
+	} else {
+		while(_index + 1 < tempos.size() && tempos[_index + 1].start <= units){
+			++_index;
+		}
+	}
+	return _map->secondsAt(units, _index);
+}
+
+EventPairing::EventPairing(NotePairing pairing) : _retrigger(pairing == NotePairing::RETRIGGER), _popFront(pairing != NotePairing::LIFO) {
+
+}
+
+bool EventPairing::isRelevant(const MIDIEvent & event){
+	if(event.category != EventCategory::MIDI){
+		return false;
+	}
+	if(event.type == noteOn || event.type == noteOff){
+		return true;
+	}
+	// Handle only pedal changes.
+	const int rawType = event.message.note;
+	return event.type == controllerChange && (rawType == 64 || rawType == 66 || rawType == 67 || rawType == 11);
+}
+
+void EventPairing::process(const MIDIEvent & event, uint32_t ticks, TempoMap::Cursor & tempos, unsigned int trackId, NoteStore & notes, std::vector<MIDIPedal> & pedals){
+	// Handle notes.
+	if(event.type == noteOn || event.type == noteOff){
+		// Ensure the ID is in 0-127.
+		const short noteInd = clamp<short>(event.message.note, 0, 127);
+		const short velocity = clamp<short>(event.message.velocity, 0, 127);
+		const short channel = event.message.channel;
+
+		const size_t slot = OpenNotesTable::slot(channel, noteInd);
+		const bool shouldNew = event.type == noteOn && velocity > 0;
+
+		// When retriggering, any event on an active key finishes the current note.
+		// Otherwise overlapping notes are only finished by note off events.
+		if(!_notes.empty(slot) && (_retrigger || !shouldNew)){
+			const OpenNotesTable::OpenNote note = _notes.pop(slot, _popFront);
+			// Create the final note with timing.
+			notes.push(note.start, ticks - note.start, uint8_t(noteInd), uint8_t(note.velocity), uint8_t(channel), uint16_t(trackId));
+		}
+
+		// Check if we have to start a new note.
+		if(shouldNew){
+			_notes.push(slot, ticks, velocity);
+		}
+	} else if(event.type == controllerChange){
+		const int rawType = clamp<int>(event.message.note, 0, 127);
+		const PedalType type = PedalType(rawType);
+		const double time = tempos.secondsAt(ticks);
+
+		OpenPedal & pedal = _pedals[rawType];
+		if(pedal.active){
+			// Stop the current event, store it.
+			const double duration = time - pedal.start;
+			if(duration > 0.0){
+				pedals.emplace_back(type, pedal.start, duration, float(pedal.velocity));
+			}
+			// Remove press.
+			pedal.active = false;
+		}
+		// Check if we have to start a new press.
+		const short val = clamp<short>(event.message.velocity, 0, 127);
+		if(val > 0){
+			pedal.start = time;
+			pedal.startTicks = ticks;
+			pedal.velocity = val;
+			pedal.active = true;
+		}
+	}
+}
+
+uint32_t EventPairing::earliestOpenEvent() const {
+	uint32_t start = _notes.earliestStart();
+	for(const auto & pedal : _pedals){
+		if(pedal.active){
+			start = (std::min)(start, pedal.startTicks);
+		}
+	}
+	return start;
+}
+
+NoteStore::NoteStore() : _tempoMap(std::make_shared<const TempoMap>()) {
+
+}
+
+void NoteStore::push(uint32_t start, uint32_t duration, uint8_t key, uint8_t velocity, uint8_t channel, uint16_t track){
+	_starts.push_back(start);
+	_durations.push_back(duration);
+	_keys.push_back(key);
+	_velocities.push_back(velocity);
+	_channels.push_back(channel);
+	_sets.push_back(0);
+	_tracks.push_back(track);
+}
+
+void NoteStore::append(const NoteStore & other){
+	_starts.insert(_starts.end(), other._starts.begin(), other._starts.end());
+	_durations.insert(_durations.end(), other._durations.begin(), other._durations.end());
+	_keys.insert(_keys.end(), other._keys.begin(), other._keys.end());
+	_velocities.insert(_velocities.end(), other._velocities.begin(), other._velocities.end());
+	_channels.insert(_channels.end(), other._channels.begin(), other._channels.end());
+	_sets.insert(_sets.end(), other._sets.begin(), other._sets.end());
+	_tracks.insert(_tracks.end(), other._tracks.begin(), other._tracks.end());
+}
+
+template<typename T>
+static void appendIndexed(std::vector<T> & dst, const std::vector<T> & src, const std::vector<uint32_t> & indices){
+	const size_t first = dst.size();
+	dst.resize(first + indices.size());
+	for(size_t i = 0; i < indices.size(); ++i){
+		dst[first + i] = src[indices[i]];
+	}
+}
+
+void NoteStore::append(const NoteStore & other, const std::vector<uint32_t> & indices){
+	appendIndexed(_starts, other._starts, indices);
+	appendIndexed(_durations, other._durations, indices);
+	appendIndexed(_keys, other._keys, indices);
+	appendIndexed(_velocities, other._velocities, indices);
+	appendIndexed(_channels, other._channels, indices);
+	appendIndexed(_sets, other._sets, indices);
+	appendIndexed(_tracks, other._tracks, indices);
+}
+
+void NoteStore::merge(const std::vector<const NoteStore*> & stores){
+	std::vector<size_t> sizes(stores.size());
+	size_t total = size();
+	for(size_t sid = 0; sid < stores.size(); ++sid){
+		sizes[sid] = stores[sid]->size();
+		total += sizes[sid];
+	}
+	reserve(total);
+	mergeSorted(sizes, [&stores](size_t sid, size_t id){
+		return stores[sid]->_starts[id];
+	}, [this, &stores](size_t sid, size_t id){
+		pushFrom(*stores[sid], id);
+	});
+}
+
+void NoteStore::pushFrom(const NoteStore & other, size_t id){
+	_starts.push_back(other._starts[id]);
+	_durations.push_back(other._durations[id]);
+	_keys.push_back(other._keys[id]);
+	_velocities.push_back(other._velocities[id]);
+	_channels.push_back(other._channels[id]);
+	_sets.push_back(other._sets[id]);
+	_tracks.push_back(other._tracks[id]);
+}
+
+void NoteStore::reorder(const std::vector<uint32_t> & order){
+	NoteStore sorted;
+	sorted._tempoMap = _tempoMap;
+	sorted.append(*this, order);
+	std::swap(*this, sorted);
+}
+
+void NoteStore::reserve(size_t count){
+	_starts.reserve(count);
+	_durations.reserve(count);
+	_keys.reserve(count);
+	_velocities.reserve(count);
+	_channels.reserve(count);
+	_sets.reserve(count);
+	_tracks.reserve(count);
+}
+
+void NoteStore::clear(){
+	_starts.clear();
+	_durations.clear();
+	_keys.clear();
+	_velocities.clear();
+	_channels.clear();
+	_sets.clear();
+	_tracks.clear();
+}
+
+std::vector<uint32_t> NoteStore::sortedByStart() const {
+	std::vector<uint32_t> order(size());
+	for(size_t i = 0; i < order.size(); ++i){
+		order[i] = uint32_t(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b){
+		return _starts[a] < _starts[b];
+	});
+	return order;
+}
+
+MIDINote NoteStore::note(size_t id) const {
+	const double startTime = start(id);
+	MIDINote note(short(_keys[id]), startTime, end(id) - startTime, short(_velocities[id]), short(_channels[id]), _tracks[id]);
+	note.set = _sets[id];
+	return note;
+}
+
+NoteStore::Cursor::Cursor(const NoteStore & store) : _store(&store), _starts(*store._tempoMap), _ends(*store._tempoMap) {
+
+}
+
+void NoteStore::Cursor::times(size_t id, double & start, double & duration){
+	start = _starts.secondsAt(_store->startTicks(id));
+	duration = _ends.secondsAt(_store->endTicks(id)) - start;
+}
+
 MIDIPedal::MIDIPedal(PedalType aType, double aStart, double aDuration, float aVelocity) : start(aStart), duration(aDuration), type(aType), velocity(aVelocity) {
 
 }
@@ -26,15 +291,15 @@ void MIDINote::print() const {
 
 void MIDIEvent::print() const {
 	if(category == EventCategory::SYSTEM){
-		std::cout << "[INFO]: " << "Sysex event (" << delta << "): type is "<< std::hex << std::showbase << type << std::dec << ", length is " << data.size() << std::endl;
+		std::cout << "[INFO]: " << "Sysex event (" << delta << "): type is "<< std::hex << std::showbase << int(type) << std::dec << ", length is " << payload.length << std::endl;
 	} else if (category == EventCategory::META){
-		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << data.size() << std::endl;
+		std::cout << "[INFO]: " << "Meta event (" << delta << "): type is " << metaEventTypeName[static_cast<MetaEventType>(type)] << ", length is " << payload.length << std::endl;
 	} else if (category == EventCategory::MIDI){
 		const auto typeName = MIDIEventTypeName.find(static_cast<MIDIEventType>(type));
 		if(typeName != MIDIEventTypeName.end()){
-			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << data[0] << " with note " << data[1] << " and velocity " << data[2] << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event " << typeName->second << " (" << delta << ") on channel " << int(message.channel) << " with note " << int(message.note) << " and velocity " << int(message.velocity) << "." << std::endl;
 		} else {
-			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << "), data size " << data.size() << "." << std::endl;
+			std::cout << "[INFO]: " << "MIDI Event unknown (" << delta << ")." << std::endl;
 		}
 	}
 }
@@ -47,82 +312,110 @@ void MIDIPedal::print() const {
 	std::cout << "[INFO]: Pedal " << int(type) << " (at "<< start << "s, " << duration << "s) with velocity " << velocity << "." << std::endl;
 }
 
-MIDIEvent MIDIEvent::readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte){
-
-	uint8_t firstByte = read8(buffer, position);
-	size_t positionOffset = 1;
+// Number of data bytes following each status, by high nibble.
+// Data bytes with no previous status are decoded as a three bytes message.
+static const uint8_t dataBytesCounts[16] = {2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 2, 1, 1, 2, 0};
+
+MIDIEvent MIDIEvent::readMIDIEvent(const MIDISpan & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte){
+
+	// With running status, the status byte is omitted and the previous one applies.
+	const uint8_t firstByte = read8(buffer, position);
+	const uint8_t hasStatus = firstByte >> 7;
+	const uint8_t status = hasStatus ? firstByte : previousFirstByte;
+	position += hasStatus;
+
+	const uint8_t dataCount = dataBytesCounts[status >> 4];
+	const uint8_t secondByte = read8(buffer, position);
+	const uint8_t thirdByte = dataCount == 2 ? read8(buffer, position + 1) : 0;
+	position += dataCount;
+
+	MIDIEvent event;
+	event.category = EventCategory::MIDI;
+	event.type = status >> 4;
+	event.delta = uint32_t(delta);
+	event.message.channel = status & 0x0F;
+	event.message.note = secondByte;
+	event.message.velocity = thirdByte;
+
+	// System messages don't change the running status.
+	previousFirstByte = status < 0xF0 ? status : previousFirstByte;
+	return event;
+}
 
-	MIDIEventType type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-	/*if (type == ignoreType) {
-		position += positionOffset;
-		return MIDIEvent(midiEvent, static_cast<uint8_t>(type), delta, {});
-	}*/
+bool MIDIEvent::isUsedMeta(uint8_t type){
+	return type == setTempo || type == timeSignature || type == keySignature || type == sequenceName || type == instrumentName;
+}
 
-	uint8_t secondByte = read8(buffer, position+1);
-	uint8_t thirdByte = 0;
-	positionOffset += 1;
-	if(type != programChange && type != channelPressure){
-		thirdByte = read8(buffer, position+2);
-		positionOffset += 1;
+bool MIDIEvent::readEvent(const MIDISpan & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte, std::vector<uint8_t> & payloads, bool selective, MIDIEvent & event){
+	const uint8_t firstByte = read8(buffer, position);
+	if(firstByte != 0xFF && (firstByte < 0xF0 || firstByte > 0xF7)){
+		event = readMIDIEvent(buffer, position, delta, previousFirstByte);
+		return !selective || EventPairing::isRelevant(event);
 	}
-
-	if(MIDIEventTypeName.count(type) == 0){
-		thirdByte = secondByte;
-		secondByte = firstByte;
-		firstByte = previousFirstByte;
-		positionOffset -= 1;
+	if(selective){
+		// Skip the payload by length, keeping only metadata used for display.
+		const bool isMeta = firstByte == 0xFF;
+		const uint8_t type = isMeta ? read8(buffer, position + 1) : firstByte;
+		if(!isMeta || !isUsedMeta(type)){
+			position += isMeta ? 2 : 1;
+			const size_t length = readVarLen(buffer, position);
+			position += length;
+			return false;
+		}
 	}
-
-	type = static_cast<MIDIEventType>((firstByte & 0xF0) >> 4);
-
-	short channel = firstByte & 0x0F;
-
-	short note = short(secondByte);
-	short velocity = short(thirdByte);
-
-	std::vector<short> data;
-	data.push_back(channel);
-	data.push_back(note);
-	data.push_back(velocity);
-
-	previousFirstByte = firstByte;
-	position += positionOffset;
-
-	return MIDIEvent(EventCategory::MIDI, static_cast<uint8_t>(type), delta, data);
+	if(firstByte == 0xFF){
+		event = readMetaEvent(buffer, position, delta, payloads);
+	} else {
+		event = readSysexEvent(buffer, position, delta, payloads);
+	}
+	return true;
 }
 
+// Copy a meta or sysex payload at the end of the track arena.
+static MIDIEvent::PayloadRange readPayload(const MIDISpan & buffer, size_t position, size_t length, std::vector<uint8_t> & payloads){
+	// Truncated files: only keep what is available.
+	const size_t available = position < buffer.size ? (std::min)(length, buffer.size - position) : 0;
+	MIDIEvent::PayloadRange range;
+	range.offset = uint32_t(payloads.size());
+	range.length = uint32_t(available);
+	if(available > 0){
+		payloads.insert(payloads.end(), buffer.data + position, buffer.data + position + available);
+	}
+	return range;
+}
 
-MIDIEvent MIDIEvent::readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
+MIDIEvent MIDIEvent::readMetaEvent(const MIDISpan & buffer, size_t & position, size_t delta, std::vector<uint8_t> & payloads){
 	position += 1; // We already read FF.
 	MetaEventType type = static_cast<MetaEventType>(read8(buffer, position));
 	position += 1;
 
 	size_t length = readVarLen(buffer, position);
 
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
-	}
+	MIDIEvent event;
+	event.category = EventCategory::META;
+	event.type = static_cast<uint8_t>(type);
+	event.delta = uint32_t(delta);
+	event.payload = readPayload(buffer, position, length, payloads);
 
 	position = position + length;
 
-	return MIDIEvent(EventCategory::META, static_cast<uint8_t>(type), delta, data);
+	return event;
 }
 
 
-MIDIEvent MIDIEvent::readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta){
+MIDIEvent MIDIEvent::readSysexEvent(const MIDISpan & buffer, size_t & position, size_t delta, std::vector<uint8_t> & payloads){
 	uint8_t type = read8(buffer, position);
 	position += 1;
 
 	size_t length = readVarLen(buffer,position);
 
-	std::vector<short> data;
-	for(size_t i = 0; i < length; ++i){
-		data.push_back(short(read8(buffer, position + i)));
-	}
+	MIDIEvent event;
+	event.category = EventCategory::SYSTEM;
+	event.type = type;
+	event.delta = uint32_t(delta);
+	event.payload = readPayload(buffer, position, length, payloads);
 
 	position = position + length;
 
-	return MIDIEvent(EventCategory::SYSTEM, type, delta, data);
+	return event;
 }
-
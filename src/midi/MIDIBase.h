@@ -3,6 +3,10 @@
 
 #include "MIDIUtils.h"
 
+#include <limits>
+#include <algorithm>
+#include <memory>
+
 struct MIDINote {
 
 	MIDINote(short aNote, double aStart, double aDuration, short aVelocity, short aChannel, unsigned int trackId);
@@ -30,22 +34,45 @@ struct MIDIPedal {
 	PedalType type;
 };
 
+// Compact event record. Channel messages store their bytes inline,
+// meta and sysex events reference a range in the track payload arena.
 struct MIDIEvent {
 
-	MIDIEvent(EventCategory aCategory, uint8_t aType, size_t aDelta, std::vector<short> aData);
+	MIDIEvent();
 
 	void print() const;
 
-	static MIDIEvent readMIDIEvent(const std::vector<char> & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte);
+	static MIDIEvent readMIDIEvent(const MIDISpan & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte);
+
+	static MIDIEvent readMetaEvent(const MIDISpan & buffer, size_t & position, size_t delta, std::vector<uint8_t> & payloads);
+
+	static MIDIEvent readSysexEvent(const MIDISpan & buffer, size_t & position, size_t delta, std::vector<uint8_t> & payloads);
 
-	static MIDIEvent readMetaEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+	/// Read any event. In selective mode, events not used for display are skipped without copying their payload,
+	/// and false is returned: their delta should be carried over to the next event.
+	static bool readEvent(const MIDISpan & buffer, size_t & position, size_t delta, uint8_t & previousFirstByte, std::vector<uint8_t> & payloads, bool selective, MIDIEvent & event);
 
-	static MIDIEvent readSysexEvent(const std::vector<char> & buffer, size_t & position, size_t delta);
+	/// Tempo, signatures and names, the only meta events used for display.
+	static bool isUsedMeta(uint8_t type);
 
+	struct MessageData {
+		uint8_t channel;
+		uint8_t note;
+		uint8_t velocity;
+	};
+
+	struct PayloadRange {
+		uint32_t offset;
+		uint32_t length;
+	};
+
+	uint32_t delta;
+	union {
+		MessageData message; ///< For MIDI events.
+		PayloadRange payload; ///< For meta and sysex events.
+	};
 	EventCategory category;
 	uint8_t type;
-	size_t delta;
-	std::vector<short> data;
 
 };
 
@@ -62,6 +89,277 @@ struct MIDITempo {
 	double timestamp = 0.0;
 };
 
+// Conversion from MIDI units to seconds, for a sorted list of tempo changes.
+class TempoMap {
+
+public:
+
+	// Incremental lookup, for units queried in increasing order.
+	class Cursor {
+	public:
+
+		Cursor(const TempoMap & map);
+
+		double secondsAt(size_t units);
+
+	private:
+		const TempoMap* _map;
+		size_t _index = 0;
+	};
+
+	TempoMap();
+
+	/// Tempos must be sorted by start, with a first tempo at 0. Timestamps are computed here.
+	TempoMap(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote);
+
+	/// Binary search lookup.
+	double secondsAt(size_t units) const;
+
+	/// Add a tempo change starting after all existing ones, or replace the last one if they start at the same time.
+	void append(size_t start, unsigned int tempo);
+
+	Cursor cursor() const { return Cursor(*this); }
+
+	const std::vector<MIDITempo> & tempos() const { return _tempos; }
+
+	uint16_t unitsPerQuarterNote() const { return _unitsPerQuarterNote; }
+
+private:
+
+	size_t tempoIndex(size_t units) const;
+
+	double secondsAt(size_t units, size_t index) const;
+
+	std::vector<MIDITempo> _tempos;
+	uint16_t _unitsPerQuarterNote = 1;
+};
+
+// Notes stored attribute per attribute, with timings in ticks converted to seconds through a tempo map.
+// This takes 14 bytes per note, instead of 40 for a MIDINote.
+class NoteStore {
+
+public:
+
+	// Incremental conversion to seconds, for notes visited in increasing start order.
+	class Cursor {
+	public:
+
+		Cursor(const NoteStore & store);
+
+		void times(size_t id, double & start, double & duration);
+
+	private:
+		const NoteStore* _store;
+		TempoMap::Cursor _starts;
+		TempoMap::Cursor _ends;
+	};
+
+	NoteStore();
+
+	void push(uint32_t start, uint32_t duration, uint8_t key, uint8_t velocity, uint8_t channel, uint16_t track);
+
+	/// Append all notes of another store.
+	void append(const NoteStore & other);
+
+	/// Append the notes of another store at the given indices.
+	void append(const NoteStore & other, const std::vector<uint32_t> & indices);
+
+	/// Append the notes of several stores sorted by start, keeping them sorted. Simultaneous notes are ordered by store.
+	void merge(const std::vector<const NoteStore*> & stores);
+
+	/// Reorder notes, the new note at position i being the previous note at order[i].
+	void reorder(const std::vector<uint32_t> & order);
+
+	void reserve(size_t count);
+
+	void clear();
+
+	/// Indices of all notes, stable sorted by start.
+	std::vector<uint32_t> sortedByStart() const;
+
+	size_t size() const { return _starts.size(); }
+
+	bool empty() const { return _starts.empty(); }
+
+	uint32_t startTicks(size_t id) const { return _starts[id]; }
+
+	uint32_t endTicks(size_t id) const { return _starts[id] + _durations[id]; }
+
+	double start(size_t id) const { return _tempoMap->secondsAt(_starts[id]); }
+
+	double end(size_t id) const { return _tempoMap->secondsAt(endTicks(id)); }
+
+	double duration(size_t id) const { return end(id) - start(id); }
+
+	uint8_t key(size_t id) const { return _keys[id]; }
+
+	uint8_t velocity(size_t id) const { return _velocities[id]; }
+
+	uint8_t channel(size_t id) const { return _channels[id]; }
+
+	uint8_t set(size_t id) const { return _sets[id]; }
+
+	uint16_t track(size_t id) const { return _tracks[id]; }
+
+	void setSet(size_t id, int set) { _sets[id] = uint8_t(set); }
+
+	/// Expanded note, with timings in seconds.
+	MIDINote note(size_t id) const;
+
+	/// The tempo map should cover all ticks of stored notes.
+	void setTempoMap(const std::shared_ptr<const TempoMap> & tempoMap) { _tempoMap = tempoMap; }
+
+	const std::shared_ptr<const TempoMap> & tempoMap() const { return _tempoMap; }
+
+	/// Call the visitor on each attribute array, in a fixed order, for serialization.
+	template<typename Visitor>
+	void visitColumns(Visitor && visitor) const {
+		visitor(_starts); visitor(_durations); visitor(_keys); visitor(_velocities);
+		visitor(_channels); visitor(_sets); visitor(_tracks);
+	}
+
+	/// Same as above, all arrays should have the same size once visited.
+	template<typename Visitor>
+	void visitColumns(Visitor && visitor) {
+		visitor(_starts); visitor(_durations); visitor(_keys); visitor(_velocities);
+		visitor(_channels); visitor(_sets); visitor(_tracks);
+	}
+
+private:
+
+	void pushFrom(const NoteStore & other, size_t id);
+
+	std::vector<uint32_t> _starts; ///< In ticks.
+	std::vector<uint32_t> _durations; ///< In ticks.
+	std::vector<uint8_t> _keys;
+	std::vector<uint8_t> _velocities;
+	std::vector<uint8_t> _channels;
+	std::vector<uint8_t> _sets;
+	std::vector<uint16_t> _tracks;
+	std::shared_ptr<const TempoMap> _tempoMap;
+};
+
+// We will have to keep track of active notes per-channel and per-key.
+// Overlapping notes on the same slot are stored in a small list, allocated from a shared pool
+// of recycled entries, so that no allocation happens in the pairing loop once warmed up.
+class OpenNotesTable {
+public:
+
+	struct OpenNote {
+		uint32_t start;
+		short velocity;
+	};
+
+	OpenNotesTable(){
+		_first.fill(-1);
+		_last.fill(-1);
+		_entries.reserve(256);
+	}
+
+	static size_t slot(short channel, short note){
+		return size_t(channel & 0xF) * 128u + size_t(note & 0x7F);
+	}
+
+	bool empty(size_t slot) const {
+		return _first[slot] < 0;
+	}
+
+	void push(size_t slot, uint32_t start, short velocity){
+		int id = _freeList;
+		if(id >= 0){
+			_freeList = _entries[id].next;
+		} else {
+			id = int(_entries.size());
+			_entries.emplace_back();
+		}
+		Entry & entry = _entries[id];
+		entry.note = {start, velocity};
+		entry.previous = _last[slot];
+		entry.next = -1;
+		if(_last[slot] >= 0){
+			_entries[_last[slot]].next = id;
+		} else {
+			_first[slot] = id;
+		}
+		_last[slot] = id;
+	}
+
+	/// Remove the oldest (front) or most recent note of a non-empty slot.
+	OpenNote pop(size_t slot, bool front){
+		const int id = front ? _first[slot] : _last[slot];
+		Entry & entry = _entries[id];
+		if(entry.previous >= 0){
+			_entries[entry.previous].next = entry.next;
+		} else {
+			_first[slot] = entry.next;
+		}
+		if(entry.next >= 0){
+			_entries[entry.next].previous = entry.previous;
+		} else {
+			_last[slot] = entry.previous;
+		}
+		entry.next = _freeList;
+		_freeList = id;
+		return entry.note;
+	}
+
+	/// Earliest start of all open notes, or the maximum tick.
+	uint32_t earliestStart() const {
+		uint32_t start = std::numeric_limits<uint32_t>::max();
+		// The first note of each slot is the oldest one.
+		for(const int id : _first){
+			if(id >= 0){
+				start = (std::min)(start, _entries[id].note.start);
+			}
+		}
+		return start;
+	}
+
+private:
+
+	struct Entry {
+		OpenNote note;
+		int previous;
+		int next;
+	};
+
+	std::array<int, 16 * 128> _first;
+	std::array<int, 16 * 128> _last;
+	std::vector<Entry> _entries;
+	int _freeList = -1;
+};
+
+// Pair note on/off events of a track into notes, and controller changes into pedal presses.
+class EventPairing {
+
+public:
+
+	EventPairing(NotePairing pairing);
+
+	/// Is the event a note or pedal event.
+	static bool isRelevant(const MIDIEvent & event);
+
+	/// Process an event at the given time in ticks, finished notes and pedal presses are appended to the lists.
+	void process(const MIDIEvent & event, uint32_t ticks, TempoMap::Cursor & tempos, unsigned int trackId, NoteStore & notes, std::vector<MIDIPedal> & pedals);
+
+	/// Earliest start in ticks of all notes and pedals still waiting for their end, or the maximum tick.
+	uint32_t earliestOpenEvent() const;
+
+private:
+
+	struct OpenPedal {
+		double start = 0.0;
+		uint32_t startTicks = 0;
+		short velocity = 0;
+		bool active = false;
+	};
+
+	OpenNotesTable _notes;
+	std::array<OpenPedal, 128> _pedals; ///< Indexed by controller.
+	bool _retrigger;
+	bool _popFront;
+};
+
 struct ActiveNoteInfos {
 	float start = 1000000.0f;
 	float duration = 0.0f;
@@ -0,0 +1,200 @@
+#include "MIDIBuffer.h"
+
+#include <atomic>
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+
+#ifdef _WIN32
+#undef APIENTRY
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+#ifdef _WIN32
+static std::wstring widenPath(const std::string& str){
+	const int size = MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, nullptr, 0);
+	if(size <= 0){
+		return std::wstring();
+	}
+	std::wstring result(size, L'\0');
+	MultiByteToWideChar(CP_UTF8, 0, str.c_str(), -1, &result[0], size);
+	// Remove the terminating null character.
+	result.resize(size - 1);
+	return result;
+}
+#endif
+
+MIDIBuffer::~MIDIBuffer(){
+	clear();
+}
+
+bool MIDIBuffer::load(const std::string & filePath){
+	clear();
+	// Try to map the file first, and fallback to reading it entirely.
+	return map(filePath) || read(filePath);
+}
+
+void MIDIBuffer::clear(){
+	if(_mapped && _data){
+#ifdef _WIN32
+		UnmapViewOfFile(_data);
+#else
+		munmap(const_cast<uint8_t*>(_data), _size);
+#endif
+	}
+	_storage.clear();
+	_storage.shrink_to_fit();
+	_data = nullptr;
+	_size = 0;
+	_mapped = false;
+}
+
+bool MIDIBuffer::map(const std::string & filePath){
+#ifdef _WIN32
+	const std::wstring widePath = widenPath(filePath);
+	HANDLE file = CreateFileW(widePath.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if(file == INVALID_HANDLE_VALUE){
+		return false;
+	}
+	LARGE_INTEGER fileSize;
+	if(!GetFileSizeEx(file, &fileSize) || fileSize.QuadPart == 0){
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if(mapping == nullptr){
+		CloseHandle(file);
+		return false;
+	}
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	// The view keeps the mapping alive.
+	CloseHandle(mapping);
+	CloseHandle(file);
+	if(view == nullptr){
+		return false;
+	}
+	_size = size_t(fileSize.QuadPart);
+	_data = static_cast<const uint8_t*>(view);
+#else
+	const int file = open(filePath.c_str(), O_RDONLY);
+	if(file < 0){
+		return false;
+	}
+	struct stat infos;
+	if(fstat(file, &infos) != 0 || infos.st_size <= 0){
+		close(file);
+		return false;
+	}
+	void* view = mmap(nullptr, size_t(infos.st_size), PROT_READ, MAP_PRIVATE, file, 0);
+	// The mapping stays valid once the descriptor is closed.
+	close(file);
+	if(view == MAP_FAILED){
+		return false;
+	}
+	// Tracks are parsed front to back.
+	madvise(view, size_t(infos.st_size), MADV_SEQUENTIAL);
+	_size = size_t(infos.st_size);
+	_data = static_cast<const uint8_t*>(view);
+#endif
+	_mapped = true;
+	return true;
+}
+
+bool MIDIBuffer::read(const std::string & filePath){
+#ifdef _WIN32
+	std::ifstream input(widenPath(filePath), std::ios::in | std::ios::binary | std::ios::ate);
+#else
+	std::ifstream input(filePath, std::ios::in | std::ios::binary | std::ios::ate);
+#endif
+	if(!input.is_open()){
+		return false;
+	}
+	const std::streamoff fileSize = input.tellg();
+	if(fileSize < 0){
+		return false;
+	}
+	input.seekg(0, std::ios::beg);
+	_storage.resize(size_t(fileSize));
+	input.read(reinterpret_cast<char*>(_storage.data()), fileSize);
+	_storage.resize(size_t(input.gcount()));
+	input.close();
+
+	_data = _storage.data();
+	_size = _storage.size();
+	_mapped = false;
+	return true;
+}
+
+bool MIDIBuffer::write(const std::string & filePath, const std::vector<uint8_t> & data){
+	// Truncating a file mapped by another process would make its reads fail, write next to it and move the result in place.
+	static std::atomic<unsigned int> writeIndex(0);
+	std::stringstream tempPath;
+#ifdef _WIN32
+	tempPath << filePath << MIDI_BUFFER_TEMP_SUFFIX << GetCurrentProcessId() << "_" << writeIndex++;
+#else
+	tempPath << filePath << MIDI_BUFFER_TEMP_SUFFIX << getpid() << "_" << writeIndex++;
+#endif
+	std::ofstream output = openOutput(tempPath.str());
+	if(!output.is_open()){
+		return false;
+	}
+	output.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+	output.close();
+	if(output.fail()){
+		remove(tempPath.str());
+		return false;
+	}
+#ifdef _WIN32
+	// Fails if the previous file is still mapped, it is then kept.
+	const bool moved = MoveFileExW(widenPath(tempPath.str()).c_str(), widenPath(filePath).c_str(), MOVEFILE_REPLACE_EXISTING) != 0;
+#else
+	const bool moved = std::rename(tempPath.str().c_str(), filePath.c_str()) == 0;
+#endif
+	if(!moved){
+		remove(tempPath.str());
+	}
+	return moved;
+}
+
+std::ofstream MIDIBuffer::openOutput(const std::string & filePath){
+#ifdef _WIN32
+	return std::ofstream(widenPath(filePath), std::ios::out | std::ios::binary | std::ios::trunc);
+#else
+	return std::ofstream(filePath, std::ios::out | std::ios::binary | std::ios::trunc);
+#endif
+}
+
+bool MIDIBuffer::remove(const std::string & filePath){
+#ifdef _WIN32
+	return DeleteFileW(widenPath(filePath).c_str()) != 0;
+#else
+	return unlink(filePath.c_str()) == 0;
+#endif
+}
+
+bool MIDIBuffer::status(const std::string & filePath, uint64_t & size, int64_t & modificationTime){
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA infos;
+	if(!GetFileAttributesExW(widenPath(filePath).c_str(), GetFileExInfoStandard, &infos)){
+		return false;
+	}
+	size = (uint64_t(infos.nFileSizeHigh) << 32) | uint64_t(infos.nFileSizeLow);
+	// File times are in 100ns intervals since 1601.
+	const uint64_t time = (uint64_t(infos.ftLastWriteTime.dwHighDateTime) << 32) | uint64_t(infos.ftLastWriteTime.dwLowDateTime);
+	modificationTime = int64_t(time / 10000000ull) - 11644473600ll;
+#else
+	struct stat infos;
+	if(stat(filePath.c_str(), &infos) != 0){
+		return false;
+	}
+	size = uint64_t(infos.st_size);
+	modificationTime = int64_t(infos.st_mtime);
+#endif
+	return true;
+}
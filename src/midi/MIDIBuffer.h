@@ -0,0 +1,60 @@
+#ifndef MIDI_BUFFER_H
+#define MIDI_BUFFER_H
+
+#include "MIDIUtils.h"
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Suffix of files being written, before they are moved to their final path.
+#define MIDI_BUFFER_TEMP_SUFFIX ".tmp"
+
+// Read-only access to the content of a file on disk.
+// The file is memory-mapped when possible, and loaded in memory otherwise.
+class MIDIBuffer {
+
+public:
+
+	MIDIBuffer() = default;
+
+	~MIDIBuffer();
+
+	/// Map or load the file at the given path, return false if it couldn't be opened.
+	bool load(const std::string & filePath);
+
+	/// Release the mapping or loaded data.
+	void clear();
+
+	MIDISpan span() const { return MIDISpan(_data, _size); }
+
+	bool isMapped() const { return _mapped; }
+
+	/// Write data to a file on disk, replacing it at once, return false if it couldn't be written.
+	/// Other processes that have loaded the previous file keep reading its original content.
+	static bool write(const std::string & filePath, const std::vector<uint8_t> & data);
+
+	/// Open a file on disk for writing, replacing its content.
+	static std::ofstream openOutput(const std::string & filePath);
+
+	/// Delete a file on disk, return false if it couldn't be removed.
+	static bool remove(const std::string & filePath);
+
+	/// Size and last modification time (in seconds since the Unix epoch) of a file on disk, return false if it doesn't exist.
+	static bool status(const std::string & filePath, uint64_t & size, int64_t & modificationTime);
+
+	MIDIBuffer(const MIDIBuffer&) = delete;
+	MIDIBuffer& operator=(const MIDIBuffer&) = delete;
+
+private:
+
+	bool map(const std::string & filePath);
+
+	bool read(const std::string & filePath);
+
+	std::vector<uint8_t> _storage; ///< Fallback when mapping is unavailable.
+	const uint8_t* _data = nullptr;
+	size_t _size = 0;
+	bool _mapped = false;
+};
+
+#endif
@@ -0,0 +1,157 @@
+#include "MIDICache.h"
+#include "MIDIFile.h"
+#include "MIDIBuffer.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <ctime>
+#include <iomanip>
+#include <sstream>
+
+// Arrays are aligned on this size in cache files.
+#define MIDI_CACHE_ALIGNMENT 8
+
+void MIDICacheWriter::writeBytes(const void* data, size_t size){
+	const size_t pos = _data.size();
+	const size_t paddedSize = (size + MIDI_CACHE_ALIGNMENT - 1) / MIDI_CACHE_ALIGNMENT * MIDI_CACHE_ALIGNMENT;
+	_data.resize(pos + paddedSize, 0);
+	if(size != 0){
+		std::memcpy(_data.data() + pos, data, size);
+	}
+}
+
+bool MIDICacheWriter::save(const std::string & path){
+	if(_data.size() < sizeof(MIDICacheHeader)){
+		return false;
+	}
+	const uint64_t size = _data.size();
+	std::memcpy(_data.data() + offsetof(MIDICacheHeader, size), &size, sizeof(uint64_t));
+
+	if(!MIDIBuffer::write(path, _data)){
+		std::cerr << "[ERROR]: Unable to write cache file at " << path << std::endl;
+		return false;
+	}
+	return true;
+}
+
+bool MIDICacheReader::readBytes(void* data, size_t size){
+	const size_t paddedSize = (size + MIDI_CACHE_ALIGNMENT - 1) / MIDI_CACHE_ALIGNMENT * MIDI_CACHE_ALIGNMENT;
+	if(_pos > _buffer.size || paddedSize > _buffer.size - _pos){
+		return false;
+	}
+	if(size != 0){
+		std::memcpy(data, _buffer.data + _pos, size);
+	}
+	_pos += paddedSize;
+	return true;
+}
+
+uint64_t computeCacheKey(const MIDISpan & buffer, const MIDILoadOptions & options){
+	// Process the content by 8 bytes words, mixing each word in the whole state.
+	const uint64_t k1 = 0x87c37b91114253d5ull;
+	const uint64_t k2 = 0x4cf5ad432745937full;
+	const auto mix = [k1, k2](uint64_t hash, uint64_t word){
+		hash ^= word * k1;
+		hash = (hash << 27) | (hash >> 37);
+		return hash * k2 + 0x52dce729ull;
+	};
+
+	uint64_t hash = 0xcbf29ce484222325ull;
+	hash = mix(hash, uint64_t(MIDI_CACHE_VERSION));
+	hash = mix(hash, uint64_t(options.notePairing));
+	hash = mix(hash, uint64_t(buffer.size));
+
+	const size_t wordCount = buffer.size / sizeof(uint64_t);
+	for(size_t wid = 0; wid < wordCount; ++wid){
+		uint64_t word;
+		std::memcpy(&word, buffer.data + wid * sizeof(uint64_t), sizeof(uint64_t));
+		hash = mix(hash, word);
+	}
+	uint64_t tail = 0;
+	for(size_t pos = wordCount * sizeof(uint64_t); pos < buffer.size; ++pos){
+		tail = (tail << 8) | buffer[pos];
+	}
+	hash = mix(hash, tail);
+
+	// Final avalanche.
+	hash ^= hash >> 33;
+	hash *= 0xff51afd7ed558ccdull;
+	hash ^= hash >> 33;
+	hash *= 0xc4ceb9fe1a85ec53ull;
+	hash ^= hash >> 33;
+	return hash;
+}
+
+std::string cacheFilePath(const std::string & directory, uint64_t key){
+	std::stringstream name;
+	name << directory << std::hex << std::setfill('0') << std::setw(16) << key << MIDI_CACHE_EXTENSION;
+	return name.str();
+}
+
+bool isValidCacheFile(const MIDISpan & buffer){
+	MIDICacheReader reader(buffer);
+	MIDICacheHeader header;
+	return reader.read(header) && header.magic == MIDI_CACHE_MAGIC && header.version == MIDI_CACHE_VERSION && header.size == buffer.size;
+}
+
+void pruneCacheDirectory(const std::string & directory, const std::vector<std::string> & fileNames){
+	struct CacheEntry {
+		std::string path;
+		uint64_t size;
+		int64_t time;
+	};
+	std::vector<CacheEntry> entries;
+	uint64_t totalSize = 0;
+	size_t removedCount = 0;
+	const int64_t now = int64_t(std::time(nullptr));
+	const std::string extension = MIDI_CACHE_EXTENSION;
+	const std::string tempExtension = extension + MIDI_BUFFER_TEMP_SUFFIX;
+
+	for(const std::string & name : fileNames){
+		CacheEntry entry = {directory + name, 0, 0};
+		if(!MIDIBuffer::status(entry.path, entry.size, entry.time)){
+			continue;
+		}
+		// Temporary files are only removed once their write has clearly been interrupted.
+		if(name.find(tempExtension) != std::string::npos){
+			if(now - entry.time > MIDI_CACHE_TEMP_MAX_AGE && MIDIBuffer::remove(entry.path)){
+				++removedCount;
+			}
+			continue;
+		}
+		if(name.size() <= extension.size() || name.compare(name.size() - extension.size(), extension.size(), extension) != 0){
+			continue;
+		}
+		// Files written by other versions are never looked up again.
+		bool valid = false;
+		{
+			MIDIBuffer input;
+			valid = input.load(entry.path) && isValidCacheFile(input.span());
+		}
+		if(!valid){
+			if(MIDIBuffer::remove(entry.path)){
+				++removedCount;
+			}
+			continue;
+		}
+		totalSize += entry.size;
+		entries.push_back(entry);
+	}
+
+	// Remove the oldest files first.
+	std::sort(entries.begin(), entries.end(), [](const CacheEntry & a, const CacheEntry & b){
+		return a.time < b.time;
+	});
+	for(const CacheEntry & entry : entries){
+		if(totalSize <= MIDI_CACHE_MAX_SIZE){
+			break;
+		}
+		if(MIDIBuffer::remove(entry.path)){
+			totalSize -= entry.size;
+			++removedCount;
+		}
+	}
+	if(removedCount != 0){
+		std::cout << "[INFO]: Removed " << removedCount << " files from the scene cache." << std::endl;
+	}
+}
@@ -0,0 +1,123 @@
+#ifndef MIDI_CACHE_H
+#define MIDI_CACHE_H
+
+#include "MIDIUtils.h"
+
+#include <cstring>
+
+// Increase when the cache layout or the notes extraction changes, to invalidate existing files.
+#define MIDI_CACHE_VERSION 3
+// "MVSC", also used to detect files written with a different byte order.
+#define MIDI_CACHE_MAGIC 0x4353564D
+#define MIDI_CACHE_EXTENSION ".mvcache"
+// Total size of the cache files above which the oldest ones are removed, in bytes.
+#define MIDI_CACHE_MAX_SIZE (512ull * 1024ull * 1024ull)
+// Age after which a temporary cache file has been abandoned by an interrupted write, in seconds.
+#define MIDI_CACHE_TEMP_MAX_AGE 3600
+
+struct MIDILoadOptions;
+
+// A cache file stores an extracted MIDIFile: this header, the tempos, then for each track
+// the note attributes and pedals. Values are in native layout and arrays are aligned on 8 bytes,
+// so that a mapped cache file is copied to memory without any parsing.
+struct MIDICacheHeader {
+	uint32_t magic = MIDI_CACHE_MAGIC;
+	uint32_t version = MIDI_CACHE_VERSION;
+	uint64_t size = 0; ///< Total size of the cache file, to detect truncated files.
+	double signature = 4.0/4.0;
+	double secondsPerMeasure = 1.0;
+	double duration = 0.0;
+	float framesPerSeconds = 0.0f;
+	uint16_t format = 0;
+	uint16_t unitsPerFrame = 0;
+	uint16_t unitsPerQuarterNote = 1;
+	uint16_t tracksStored = 0; ///< After merging.
+	int32_t notesCount = 0;
+	int32_t trackCount = 0; ///< In the source file.
+	uint32_t temposCount = 0;
+};
+
+struct MIDICacheTempo {
+	uint64_t start;
+	uint32_t tempo;
+	uint32_t padding;
+};
+
+struct MIDICacheTrack {
+	uint64_t notesCount;
+	uint64_t pedalsCount;
+};
+
+struct MIDICachePedal {
+	double start;
+	double duration;
+	float velocity;
+	uint32_t type;
+};
+
+// Sequential writing of values and arrays to a cache file in memory.
+class MIDICacheWriter {
+public:
+
+	template<typename T>
+	void write(const T & value){
+		writeBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	void writeArray(const std::vector<T> & values){
+		writeBytes(values.data(), values.size() * sizeof(T));
+	}
+
+	/// Write the content to disk, after updating the size stored in the header.
+	bool save(const std::string & path);
+
+private:
+
+	void writeBytes(const void* data, size_t size);
+
+	std::vector<uint8_t> _data;
+};
+
+// Sequential reading of values and arrays from a cache file, with bound checks.
+class MIDICacheReader {
+public:
+
+	MIDICacheReader(const MIDISpan & buffer) : _buffer(buffer) {}
+
+	template<typename T>
+	bool read(T & value){
+		return readBytes(&value, sizeof(T));
+	}
+
+	template<typename T>
+	bool readArray(std::vector<T> & values, size_t count){
+		if(count > (_buffer.size - _pos) / sizeof(T)){
+			return false;
+		}
+		values.resize(count);
+		return readBytes(values.data(), count * sizeof(T));
+	}
+
+private:
+
+	bool readBytes(void* data, size_t size);
+
+	MIDISpan _buffer;
+	size_t _pos = 0;
+};
+
+/// Hash of a source file content, also covering the load options that affect extracted notes.
+uint64_t computeCacheKey(const MIDISpan & buffer, const MIDILoadOptions & options);
+
+/// Path of the cache file for a key, in a directory path ending with a separator.
+std::string cacheFilePath(const std::string & directory, uint64_t key);
+
+/// Check that a cache file was written by this version and is complete.
+bool isValidCacheFile(const MIDISpan & buffer);
+
+/// Remove files from other versions or abandoned writes, then the oldest files until the cache fits in MIDI_CACHE_MAX_SIZE.
+/// The directory path ends with a separator, and the names of the files it contains are given.
+void pruneCacheDirectory(const std::string & directory, const std::vector<std::string> & fileNames);
+
+#endif // MIDI_CACHE_H
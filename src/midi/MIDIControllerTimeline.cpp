@@ -0,0 +1,107 @@
+#include "MIDIControllerTimeline.h"
+
+#include <algorithm>
+
+MIDIControllerTimeline::MIDIControllerTimeline(){
+	clear();
+}
+
+void MIDIControllerTimeline::append(float time, uint8_t controller, uint8_t value){
+	if(!_chunks.empty()){
+		const Chunk & last = _chunks.back();
+		// Recording again over an existing time range (after rewinding) restarts the history from there.
+		if(last.changes[last.count - 1].time > time){
+			truncate(time);
+		}
+	}
+	if(_chunks.empty() || _chunks.back().count == CONTROLLER_CHUNK_SIZE){
+		_chunks.emplace_back();
+		_chunks.back().start = _latest;
+	}
+	Chunk & chunk = _chunks.back();
+	controller &= 0x7F;
+	chunk.changes[chunk.count] = {time, controller, value};
+	++chunk.count;
+	_latest[controller] = value;
+}
+
+const MIDIControllerTimeline::Values & MIDIControllerTimeline::valuesAt(float time){
+	if(!_cursorValid || time < _cursorTime){
+		// Start from the snapshot of the last chunk starting before the time.
+		const auto chunk = std::upper_bound(_chunks.begin(), _chunks.end(), time, [](float value, const Chunk & a){
+			return value < a.changes[0].time;
+		});
+		_cursorChunk = chunk == _chunks.begin() ? 0 : size_t(chunk - _chunks.begin()) - 1;
+		_cursorChange = 0;
+		_cursorValues = _chunks.empty() ? _latest : _chunks[_cursorChunk].start;
+		_cursorValid = true;
+	}
+	advance(time);
+	_cursorTime = time;
+	return _cursorValues;
+}
+
+void MIDIControllerTimeline::discardBefore(float time){
+	// Keep the chunk covering the time.
+	size_t count = 0;
+	while(count + 1 < _chunks.size() && _chunks[count + 1].changes[0].time <= time){
+		++count;
+	}
+	if(count == 0){
+		return;
+	}
+	_chunks.erase(_chunks.begin(), _chunks.begin() + count);
+	if(_cursorChunk >= count){
+		_cursorChunk -= count;
+	} else {
+		_cursorValid = false;
+	}
+}
+
+void MIDIControllerTimeline::clear(){
+	_chunks.clear();
+	_latest.fill(0);
+	_cursorValues.fill(0);
+	_cursorChunk = 0;
+	_cursorChange = 0;
+	_cursorValid = false;
+}
+
+size_t MIDIControllerTimeline::changesCount() const {
+	return _chunks.empty() ? 0 : ((_chunks.size() - 1) * CONTROLLER_CHUNK_SIZE + _chunks.back().count);
+}
+
+void MIDIControllerTimeline::truncate(float time){
+	while(!_chunks.empty() && _chunks.back().changes[0].time > time){
+		_latest = _chunks.back().start;
+		_chunks.pop_back();
+	}
+	if(!_chunks.empty()){
+		Chunk & chunk = _chunks.back();
+		while(chunk.changes[chunk.count - 1].time > time){
+			--chunk.count;
+		}
+		_latest = chunk.start;
+		for(size_t cid = 0; cid < chunk.count; ++cid){
+			_latest[chunk.changes[cid].controller] = chunk.changes[cid].value;
+		}
+	}
+	_cursorValid = false;
+}
+
+void MIDIControllerTimeline::advance(float time){
+	while(_cursorChunk < _chunks.size()){
+		const Chunk & chunk = _chunks[_cursorChunk];
+		while(_cursorChange < chunk.count && chunk.changes[_cursorChange].time <= time){
+			const Change & change = chunk.changes[_cursorChange];
+			_cursorValues[change.controller] = change.value;
+			++_cursorChange;
+		}
+		// Move to the next chunk once this one is full and replayed.
+		if(_cursorChange < CONTROLLER_CHUNK_SIZE || _cursorChunk + 1 >= _chunks.size()){
+			break;
+		}
+		++_cursorChunk;
+		_cursorChange = 0;
+	}
+}
@@ -0,0 +1,65 @@
+#ifndef MIDI_CONTROLLER_TIMELINE_H
+#define MIDI_CONTROLLER_TIMELINE_H
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Number of controller changes stored between two snapshots of all controllers.
+#define CONTROLLER_CHUNK_SIZE 64
+
+// Values of all controllers over time, stored as an append-only list of chunks of changes.
+// Each chunk starts with a snapshot of all controllers, so that the values at a given time
+// only require a search among chunks and the replay of a few changes.
+class MIDIControllerTimeline {
+public:
+
+	typedef std::array<uint8_t, 128> Values;
+
+	MIDIControllerTimeline();
+
+	/// Register a change of a controller. Changes registered after this time are discarded.
+	void append(float time, uint8_t controller, uint8_t value);
+
+	/// Values of all controllers at a given time, increasing queries only replay the new changes.
+	const Values & valuesAt(float time);
+
+	/// Release chunks of changes that are all older than the given time.
+	void discardBefore(float time);
+
+	void clear();
+
+	size_t changesCount() const;
+
+private:
+
+	struct Change {
+		float time;
+		uint8_t controller;
+		uint8_t value;
+	};
+
+	struct Chunk {
+		Values start; ///< Values before the first change.
+		std::array<Change, CONTROLLER_CHUNK_SIZE> changes;
+		size_t count = 0;
+	};
+
+	/// Discard changes after the given time.
+	void truncate(float time);
+
+	/// Replay changes from the cursor position up to a given time.
+	void advance(float time);
+
+	std::deque<Chunk> _chunks;
+	Values _latest; ///< Values after the last change.
+
+	Values _cursorValues; ///< Values at the cursor time.
+	size_t _cursorChunk = 0;
+	size_t _cursorChange = 0; ///< Next change to replay in the cursor chunk.
+	float _cursorTime = 0.0f;
+	bool _cursorValid = false;
+};
+
+#endif
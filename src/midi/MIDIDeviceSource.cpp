@@ -0,0 +1,89 @@
+#include "MIDIDeviceSource.h"
+
+#include <algorithm>
+
+MIDIDeviceSource::MIDIDeviceSource(int port) : _port(port) {
+	if(_port >= 0){
+		// The port index refers to the last listed ports.
+		_name = size_t(_port) < _availablePorts.size() ? _availablePorts[_port] : "";
+	} else {
+		_name = VIRTUAL_DEVICE_NAME;
+	}
+}
+
+MIDIDeviceSource::~MIDIDeviceSource(){
+	stop();
+}
+
+bool MIDIDeviceSource::start(MIDIInputQueue & queue){
+	// For now we use the same MIDI in instance for everything.
+	if(shared().is_port_open()){
+		shared().close_port();
+	}
+	_lastArrival = -1.0;
+	_target = &queue;
+	if(_port >= 0){
+		shared().open_port(_port, "MIDIVisualizer input");
+	} else {
+		shared().open_virtual_port("MIDIVisualizer virtual input");
+	}
+	shared().ignore_types(true, true, true);
+	_portOwner = this;
+	return true;
+}
+
+void MIDIDeviceSource::stop(){
+	// A new source might already have reopened the port.
+	if(_portOwner == this){
+		shared().close_port();
+		_target = nullptr;
+		_portOwner = nullptr;
+	}
+}
+
+libremidi::midi_in * MIDIDeviceSource::_sharedMIDIIn = nullptr;
+std::atomic<MIDIInputQueue*> MIDIDeviceSource::_target{nullptr};
+const MIDIDeviceSource * MIDIDeviceSource::_portOwner = nullptr;
+std::vector<std::string> MIDIDeviceSource::_availablePorts;
+int MIDIDeviceSource::_refreshIndex = 0;
+double MIDIDeviceSource::_lastArrival = -1.0;
+
+libremidi::midi_in & MIDIDeviceSource::shared(){
+	if(_sharedMIDIIn == nullptr){
+		_sharedMIDIIn = new libremidi::midi_in(libremidi::API::UNSPECIFIED, "MIDIVisualizer");
+		// Messages are queued as soon as they are received by the backend thread, without locking.
+		_sharedMIDIIn->set_callback([](const libremidi::message& message){
+			MIDIInputQueue* queue = _target.load(std::memory_order_acquire);
+			if(queue){
+				queue->push(message.bytes.data(), message.bytes.size(), arrivalTime(message.timestamp));
+			}
+		});
+	}
+	return *_sharedMIDIIn;
+}
+
+double MIDIDeviceSource::arrivalTime(double delta){
+	// Drivers timestamp messages when they are received, and several messages can be delivered at once.
+	// Chain the delays between messages, and realign on the reception time when they drift away from it.
+	const double now = MIDIInputQueue::now();
+	double arrival = _lastArrival + (std::max)(delta, 0.0);
+	if(_lastArrival < 0.0 || arrival > now || (now - arrival) > DEVICE_MAX_DELAY){
+		arrival = now;
+	}
+	_lastArrival = arrival;
+	return arrival;
+}
+
+const std::vector<std::string> & MIDIDeviceSource::availablePorts(bool force){
+	if((_refreshIndex == 0) || force){
+		const int portCount = shared().get_port_count();
+		_availablePorts.resize(portCount);
+
+		for(int i = 0; i < portCount; ++i){
+			_availablePorts[i] = shared().get_port_name(i);
+		}
+	}
+	// Only update once every 15 frames.
+	_refreshIndex = (_refreshIndex + 1) % 15;
+	return _availablePorts;
+}
@@ -0,0 +1,48 @@
+#ifndef MIDI_DEVICE_SOURCE_H
+#define MIDI_DEVICE_SOURCE_H
+
+#include "MIDIInputSource.h"
+
+#include <libremidi/libremidi.hpp>
+
+#define VIRTUAL_DEVICE_NAME "VIRTUAL"
+// Largest delay in seconds between a driver timestamp and the reception of its message before timestamps are realigned.
+#define DEVICE_MAX_DELAY 0.05
+
+// Messages received from a MIDI device, or from a virtual port other applications can connect to.
+// All sources share the same MIDI input, only the last started one receives messages.
+class MIDIDeviceSource : public MIDIInputSource {
+public:
+
+	/// Listen to the port at the given index, or to a new virtual port if negative.
+	explicit MIDIDeviceSource(int port);
+
+	~MIDIDeviceSource() override;
+
+	bool start(MIDIInputQueue & queue) override;
+
+	void stop() override;
+
+	const std::string & name() const override { return _name; }
+
+	static const std::vector<std::string> & availablePorts(bool force = false);
+
+private:
+
+	static libremidi::midi_in & shared();
+
+	/// Arrival time of a message on the queue clock, from the driver delay since the previous message.
+	static double arrivalTime(double delta);
+
+	int _port;
+	std::string _name;
+
+	static libremidi::midi_in * _sharedMIDIIn;
+	static std::atomic<MIDIInputQueue*> _target; ///< Queue filled by the MIDI backend thread.
+	static const MIDIDeviceSource * _portOwner; ///< Source that opened the current port.
+	static std::vector<std::string> _availablePorts;
+	static int _refreshIndex;
+	static double _lastArrival; ///< Only used by the MIDI backend thread.
+};
+
+#endif
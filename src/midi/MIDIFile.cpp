@@ -1,55 +1,52 @@
 #include <algorithm>
-#include <iterator>
-#include <fstream>
+#include <chrono>
 
 #include "MIDIFile.h"
-#include "../helpers/System.h"
-#include "../rendering/State.h"
+#include "MIDIBuffer.h"
+#include "MIDIStream.h"
+#include "MIDICache.h"
+#include "../rendering/FilterOptions.h"
 
 MIDIFile::MIDIFile(){};
 
-MIDIFile::MIDIFile(const std::string & filePath){
-	std::ifstream input = System::openInputFile(filePath, true);
-
-	if(!input.is_open()) {
-		std::cerr << "[ERROR]: Couldn't find file at path " << filePath << std::endl;
-		throw "BadInput";
-	}
-	
-	std::vector<char> buffer;
-	std::copy(std::istreambuf_iterator<char>(input),
-			  std::istreambuf_iterator<char>(),
-			  std::back_inserter(buffer));
-	input.close();
+MIDIFile::MIDIFile(const MIDIHeader & header){
+	_format = header.format;
+	_unitsPerFrame = header.unitsPerFrame;
+	_framesPerSeconds = header.framesPerSeconds;
+	_unitsPerQuarterNote = header.unitsPerQuarterNote;
+	_trackCount = header.tracksCount;
+	// Streamed notes are merged in a unique track.
+	_tracks.resize(1);
+}
 
+MIDIHeader MIDIFile::readHeader(const MIDISpan & buffer, const std::string & filePath){
 	// Check midi header
-	if(buffer.size() < 5 || !(buffer[0] == 'M' && buffer[1] == 'T' && buffer[2] == 'h' && buffer[3] == 'd') || read32(buffer, 4) != 6){
+	if(buffer.size < 14 || !(buffer[0] == 'M' && buffer[1] == 'T' && buffer[2] == 'h' && buffer[3] == 'd') || read32(buffer, 4) != 6){
 		std::cerr << "[ERROR]: " << filePath << " is not a midi file." << std::endl;
 		throw "BadInput";
 	}
-	
-	_format = static_cast<MIDIType>(read16(buffer, 8));
-	const uint16_t tracksCount = read16(buffer, 10);
+
+	MIDIHeader header;
+	header.format = static_cast<MIDIType>(read16(buffer, 8));
+	header.tracksCount = read16(buffer, 10);
 
 	const std::vector<std::string> formatNames = { "Single track (0)", "Tempo track (1)", "Multiple songs (2)"};
 
-	std::cout << "[INFO]: " << tracksCount << " tracks ";
-	std::cout << "(" << formatNames[int(_format)] << ")." << std::endl;
+	std::cout << "[INFO]: " << header.tracksCount << " tracks ";
+	std::cout << "(" << formatNames[int(header.format)] << ")." << std::endl;
 
-	if(_format == multipleSongs){
+	if(header.format == multipleSongs){
 		std::cerr << "[ERROR]: " << "Unsupported MIDI file (type 2)." << std::endl;
 		throw "Unsupported MIDI type (2)";
 	}
 
-	if(tracksCount == 0){
+	if(header.tracksCount == 0){
 		std::cerr << "[ERROR]: " << "No tracks." << std::endl;
 		throw "BadInput";
 	}
 
-	bool shouldMerge = false;
-	if(_format == singleTrack && tracksCount > 1){
+	if(header.format == singleTrack && header.tracksCount > 1){
 		std::cerr << "[WARNING]: " << "Too many tracks, will merge all tracks." << std::endl;
-		shouldMerge = true;
 	}
 
 	// Division mode.
@@ -57,66 +54,129 @@ MIDIFile::MIDIFile(const std::string & filePath){
 	bool divisionMode = getBit(division, 15);
 
 	if(divisionMode){
-		_unitsPerFrame = division & 0xFF;
+		header.unitsPerFrame = division & 0xFF;
 		const std::vector<float> fpsValues = {24.0f, 25.0f, 29.97f, 30.0f};
 
 		uint16_t fpsIndicator = ((division >> 8) & 0b1100000) >> 5;
 		fpsIndicator = (std::min)(fpsIndicator, uint16_t(int(fpsValues.size()) - 1));
-		_framesPerSeconds = fpsValues[fpsIndicator];
-		std::cout << "[INFO]: " << _unitsPerFrame << " units per frame, " << _framesPerSeconds << " frames per second." << std::endl;
+		header.framesPerSeconds = fpsValues[fpsIndicator];
+		std::cout << "[INFO]: " << header.unitsPerFrame << " units per frame, " << header.framesPerSeconds << " frames per second." << std::endl;
 		std::cout << "[WARN]: " << " Division mode is not well supported." << std::endl;
-		_unitsPerQuarterNote = 1;
+		header.unitsPerQuarterNote = 1;
 		
 	} else {
 		// In that case the 15th bit is 0, nothing to do.
-		_unitsPerQuarterNote = division;
-		std::cout << "[INFO]: " << _unitsPerQuarterNote << " units per quarter note ." << std::endl;
-		_unitsPerFrame = 0;
-		_framesPerSeconds = 0.0f;
+		header.unitsPerQuarterNote = division;
+		std::cout << "[INFO]: " << header.unitsPerQuarterNote << " units per quarter note ." << std::endl;
+		header.unitsPerFrame = 0;
+		header.framesPerSeconds = 0.0f;
 	}
+	return header;
+}
 
-	// Parse tracks.
+MIDIFile::MIDIFile(const std::string & filePath, const MIDILoadOptions & options){
+	auto phaseStart = std::chrono::steady_clock::now();
+	const auto endPhase = [&phaseStart](){
+		const auto phaseEnd = std::chrono::steady_clock::now();
+		const double duration = std::chrono::duration<double, std::milli>(phaseEnd - phaseStart).count();
+		phaseStart = phaseEnd;
+		return duration;
+	};
+
+	// The file content is mapped in memory and parsed in place.
+	MIDIBuffer input;
+	if(!input.load(filePath)) {
+		std::cerr << "[ERROR]: Couldn't find file at path " << filePath << std::endl;
+		throw "BadInput";
+	}
+	const MIDISpan buffer = input.span();
+	_loadStats.reading = endPhase();
+
+	// Skip parsing entirely if the same content has already been extracted.
+	const std::string cacheFile = cachePath(buffer, options);
+	const bool cached = !cacheFile.empty() && loadCache(cacheFile);
+	_loadStats.cache = endPhase();
+	if(cached){
+		std::cout << "[INFO]: Loaded " << _notesCount << " notes from cache in " << _loadStats.cache << "ms." << std::endl;
+		return;
+	}
+
+	const MIDIHeader header = readHeader(buffer, filePath);
+	_format = header.format;
+	_unitsPerFrame = header.unitsPerFrame;
+	_framesPerSeconds = header.framesPerSeconds;
+	_unitsPerQuarterNote = header.unitsPerQuarterNote;
+	const uint16_t tracksCount = header.tracksCount;
+	bool shouldMerge = _format == singleTrack && tracksCount > 1;
+
+	const unsigned int threadCount = computeThreadCount(options.threadCount, tracksCount);
+	_loadStats.threadCount = threadCount;
+
+	// Locate all track chunks, using their lengths.
+	std::vector<size_t> trackOffsets(tracksCount);
 	size_t pos = 14;
+	for(size_t trackId = 0; trackId < tracksCount; ++trackId){
+		trackOffsets[trackId] = pos;
+		pos = MIDITrack::skipTrack(buffer, pos);
+	}
+
+	// Parse tracks.
+	_tracks.resize(tracksCount);
+	parallelFor(tracksCount, threadCount, [this, &buffer, &trackOffsets, &options](size_t trackId){
+		_tracks[trackId].readTrack(buffer, trackOffsets[trackId], options.selectiveDecode);
+	});
+	_loadStats.decoding = endPhase();
+
 	for(size_t trackId = 0; trackId < tracksCount; ++trackId){
 		std::cout << "[INFO]: " << "Reading track " << trackId << "." << std::endl;
-		_tracks.emplace_back();
-		pos = _tracks.back().readTrack(buffer, pos);
+		_tracks[trackId].printInfos();
 	}
 
 	// Extract tempos and the signature.
 	populateTemposAndSignature();
+	_loadStats.tempos = endPhase();
 
 	// Update seconds per measure.
-	_secondsPerMeasure = computeMeasureDuration(_tempos[0].tempo, _signature);
+	_secondsPerMeasure = computeMeasureDuration(_tempoMap->tempos()[0].tempo, _signature);
 
 	// Convert each track to real notes.
-	for(size_t tid = 0; tid < _tracks.size(); ++tid){
+	parallelFor(_tracks.size(), threadCount, [this, &options](size_t tid){
 		auto & track = _tracks[tid];
-		track.extractNotes(_tempos, _unitsPerQuarterNote, (unsigned int)tid);
-	}
+		track.extractNotes(_tempoMap, (unsigned int)tid, options.notePairing);
+		if(options.releaseEvents){
+			track.releaseEvents();
+		}
+	});
+	_loadStats.notes = endPhase();
+
 	// Save count before merging.
 	_trackCount = _tracks.size();
 
 	// For now, still merge.
 	shouldMerge = true;
 	if(shouldMerge){
-		mergeTracks();
+		mergeTracks(threadCount);
 	}
 
+	_loadStats.merging = endPhase();
+
 	// Normalize pedal values.
 	for(auto & track : _tracks){
 		track.normalizePedalVelocity();
+		track.buildTimeline();
 	}
 
 	// Compute duration.
-	FilterOptions noFilter;
 	for(const auto & track : _tracks){
-		std::vector<MIDINote> notes;
-		track.getNotes(notes, NoteType::ALL, noFilter);
-		for(const auto & note : notes){
-			_duration = (std::max)(_duration, note.start + note.duration);
-		}
-		_notesCount += int(notes.size());
+		updateDuration(track.notes());
+		_notesCount += int(track.notes().size());
+	}
+	_loadStats.finalizing = endPhase();
+
+	std::cout << "[INFO]: Loaded with " << _loadStats.threadCount << " thread(s): reading " << _loadStats.reading << "ms, decoding " << _loadStats.decoding << "ms, tempos " << _loadStats.tempos << "ms, notes " << _loadStats.notes << "ms, merging " << _loadStats.merging << "ms, finalizing " << _loadStats.finalizing << "ms." << std::endl;
+
+	if(!cacheFile.empty()){
+		saveCache(cacheFile);
 	}
 }
 
@@ -146,45 +206,199 @@ void MIDIFile::populateTemposAndSignature(){
 	for(const auto & tempo : mixedTempos){
 		tempoChanges[tempo.start] = tempo;
 	}
+	std::vector<MIDITempo> tempos;
+	tempos.reserve(tempoChanges.size());
 	for(const auto & tempo : tempoChanges){
-		_tempos.push_back(tempo.second);
+		tempos.push_back(tempo.second);
 	}
-	std::sort(_tempos.begin(), _tempos.end(), [](const MIDITempo& a, const MIDITempo& b){
+	std::sort(tempos.begin(), tempos.end(), [](const MIDITempo& a, const MIDITempo& b){
 		return a.start < b.start;
 	});
 
-	// Compute the real time stamp of each tempo.
-	// We are guaranteed that there is an event at t = 0.
-	double currentTime = 0.0;
-	_tempos[0].timestamp = 0.0;
-	for(size_t tid = 1; tid < _tempos.size(); ++tid){
-		const int delta = int(_tempos[tid].start) - int(_tempos[tid-1].start);
-		currentTime += computeUnitsDuration(_tempos[tid-1].tempo, delta, _unitsPerQuarterNote);
-		_tempos[tid].timestamp = currentTime;
+	// Real time stamps of each tempo are computed by the map.
+	_tempoMap = std::make_shared<const TempoMap>(tempos, _unitsPerQuarterNote);
+}
+
+void MIDIFile::appendStream(const MIDIStreamBatch & batch, const SetOptions & options){
+	_signature = batch.signature;
+	_secondsPerMeasure = batch.secondsPerMeasure;
+	if(batch.notes.empty() && batch.pedals.empty()){
+		return;
 	}
+	MIDITrack & track = _tracks[0];
+	track.append(batch.notes, batch.pedals);
+	track.updateSets(options, size_t(_notesCount));
+
+	_tempoMap = batch.notes.tempoMap();
+	updateDuration(batch.notes);
+	_notesCount += int(batch.notes.size());
 }
 
-void MIDIFile::mergeTracks(){
-	
-	for(size_t i = 1; i < _tracks.size(); ++i){
-		_tracks[0].merge(_tracks[i]);
+void MIDIFile::updateDuration(const NoteStore & notes){
+	NoteStore::Cursor noteTimes(notes);
+	double start, duration;
+	for(size_t nid = 0; nid < notes.size(); ++nid){
+		noteTimes.times(nid, start, duration);
+		_duration = (std::max)(_duration, start + duration);
+	}
+}
+
+void MIDIFile::finalizeStream(){
+	for(auto & track : _tracks){
+		track.normalizePedalVelocity();
+		track.buildTimeline();
+	}
+}
+
+std::string MIDIFile::cachePath(const MIDISpan & buffer, const MIDILoadOptions & options){
+	if(options.cacheDirectory.empty()){
+		return "";
+	}
+	return cacheFilePath(options.cacheDirectory, computeCacheKey(buffer, options));
+}
+
+bool MIDIFile::loadCache(const std::string & path){
+	MIDIBuffer input;
+	if(!input.load(path)){
+		return false;
+	}
+	if(!isValidCacheFile(input.span())){
+		std::cerr << "[WARNING]: Removing outdated or invalid cache file " << path << std::endl;
+		// Release the file first, it can't be removed while mapped on some platforms.
+		input.clear();
+		MIDIBuffer::remove(path);
+		return false;
+	}
+	MIDICacheReader reader(input.span());
+	MIDICacheHeader header;
+	reader.read(header);
+
+	std::vector<MIDICacheTempo> cachedTempos;
+	if(header.temposCount == 0 || !reader.readArray(cachedTempos, header.temposCount)){
+		return false;
+	}
+	std::vector<MIDITempo> tempos;
+	tempos.reserve(cachedTempos.size());
+	for(const MIDICacheTempo & tempo : cachedTempos){
+		tempos.emplace_back(size_t(tempo.start), tempo.tempo);
+	}
+	const std::shared_ptr<const TempoMap> tempoMap = std::make_shared<const TempoMap>(tempos, header.unitsPerQuarterNote);
+
+	std::vector<MIDITrack> tracks(header.tracksStored);
+	std::vector<MIDICachePedal> cachedPedals;
+	for(MIDITrack & track : tracks){
+		MIDICacheTrack counts;
+		if(!reader.read(counts)){
+			return false;
+		}
+		NoteStore notes;
+		bool valid = true;
+		notes.visitColumns([&reader, &valid, &counts](auto & column){
+			valid = valid && reader.readArray(column, size_t(counts.notesCount));
+		});
+		if(!valid || !reader.readArray(cachedPedals, size_t(counts.pedalsCount))){
+			return false;
+		}
+		notes.setTempoMap(tempoMap);
+
+		std::vector<MIDIPedal> pedals;
+		pedals.reserve(cachedPedals.size());
+		for(const MIDICachePedal & pedal : cachedPedals){
+			pedals.emplace_back(PedalType(pedal.type), pedal.start, pedal.duration, pedal.velocity);
+		}
+		track.assign(notes, pedals);
+		track.buildTimeline();
+	}
+
+	_format = MIDIType(header.format);
+	_unitsPerFrame = header.unitsPerFrame;
+	_framesPerSeconds = header.framesPerSeconds;
+	_unitsPerQuarterNote = header.unitsPerQuarterNote;
+	_signature = header.signature;
+	_secondsPerMeasure = header.secondsPerMeasure;
+	_duration = header.duration;
+	_notesCount = header.notesCount;
+	_trackCount = header.trackCount;
+	_tempoMap = tempoMap;
+	std::swap(_tracks, tracks);
+	return true;
+}
+
+bool MIDIFile::saveCache(const std::string & path) const {
+	MIDICacheHeader header;
+	header.signature = _signature;
+	header.secondsPerMeasure = _secondsPerMeasure;
+	header.duration = _duration;
+	header.framesPerSeconds = _framesPerSeconds;
+	header.format = uint16_t(_format);
+	header.unitsPerFrame = _unitsPerFrame;
+	header.unitsPerQuarterNote = _unitsPerQuarterNote;
+	header.tracksStored = uint16_t(_tracks.size());
+	header.notesCount = _notesCount;
+	header.trackCount = _trackCount;
+	header.temposCount = uint32_t(_tempoMap->tempos().size());
+
+	MIDICacheWriter writer;
+	writer.write(header);
+
+	std::vector<MIDICacheTempo> tempos;
+	tempos.reserve(_tempoMap->tempos().size());
+	for(const MIDITempo & tempo : _tempoMap->tempos()){
+		tempos.push_back({uint64_t(tempo.start), uint32_t(tempo.tempo), 0u});
+	}
+	writer.writeArray(tempos);
+
+	std::vector<MIDICachePedal> pedals;
+	for(const MIDITrack & track : _tracks){
+		const NoteStore & notes = track.notes();
+		writer.write(MIDICacheTrack{uint64_t(notes.size()), uint64_t(track.pedals().size())});
+		notes.visitColumns([&writer](const auto & column){
+			writer.writeArray(column);
+		});
+		pedals.clear();
+		for(const MIDIPedal & pedal : track.pedals()){
+			pedals.push_back({pedal.start, pedal.duration, pedal.velocity, uint32_t(pedal.type)});
+		}
+		writer.writeArray(pedals);
 	}
+	return writer.save(path);
+}
+
+void MIDIFile::mergeTracks(unsigned int threadCount){
+	
+	_tracks[0].merge(_tracks, threadCount);
 	_tracks.resize(1);
 	
 }
 
-void MIDIFile::getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter, size_t track) const {
+void MIDIFile::getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter, size_t track, size_t first) const {
 	if(track >= _tracks.size()){
 		return;
 	}
-	_tracks[track].getNotes(notes, type, filter );
+	_tracks[track].getNotes(notes, type, filter, first );
+}
+
+const NoteStore & MIDIFile::notes(size_t track) const {
+	static const NoteStore noNotes;
+	if(track >= _tracks.size()){
+		return noNotes;
+	}
+	return _tracks[track].notes();
+}
+
+const std::vector<MIDIPedal> & MIDIFile::pedals(size_t track) const {
+	static const std::vector<MIDIPedal> noPedals;
+	if(track >= _tracks.size()){
+		return noPedals;
+	}
+	return _tracks[track].pedals();
 }
 
-void MIDIFile::getNotesActive(ActiveNotesArray & actives, double time, const FilterOptions& filter, size_t track) const {
+void MIDIFile::getNotesActive(ActiveNotesArray & actives, ActiveNotesArray & started, NoteCursor & cursor, double time, const FilterOptions& filter, size_t track) const {
 	if(track >= _tracks.size()){
 		return;
 	}
-	_tracks[track].getNotesActive(actives, time, filter);
+	_tracks[track].getNotesActive(actives, started, cursor, time, filter);
 }
 
 void MIDIFile::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time, size_t track) const {
@@ -194,6 +408,13 @@ void MIDIFile::getPedalsActive(float & damper, float &sostenuto, float &soft, fl
 	_tracks[track].getPedalsActive(damper, sostenuto, soft, expression, time);
 }
 
+void MIDIFile::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double startTime, double endTime, size_t track) const {
+	if(track >= _tracks.size()){
+		return;
+	}
+	_tracks[track].getPedalsActive(damper, sostenuto, soft, expression, startTime, endTime);
+}
+
 void MIDIFile::updateSets(const SetOptions & options){
 	for(auto & track : _tracks){
 		track.updateSets(options);
@@ -5,24 +5,83 @@
 #include "MIDIBase.h"
 #include "MIDITrack.h"
 
+struct MIDILoadOptions {
+	bool releaseEvents = false; ///< Free raw events once notes and pedals have been extracted.
+	bool selectiveDecode = false; ///< Only decode events used for display, skipping other meta, sysex and channel events.
+	unsigned int threadCount = 0; ///< Threads used to decode tracks, 0 to use all cores, 1 for serial loading.
+	NotePairing notePairing = NotePairing::RETRIGGER;
+	bool streaming = false; ///< Decode events in time order in the background, see MIDIStreamLoader.
+	std::string cacheDirectory; ///< Where extracted files are cached, ending with a separator, or empty to disable the cache.
+};
+
+struct MIDIHeader {
+	MIDIType format = MIDIType::singleTrack;
+	uint16_t tracksCount = 0;
+	uint16_t unitsPerFrame = 0;
+	float framesPerSeconds = 0.0f;
+	uint16_t unitsPerQuarterNote = 1;
+};
+
+struct MIDIStreamBatch;
+
+// Time spent in each loading phase, in milliseconds.
+struct MIDILoadStats {
+	double reading = 0.0; ///< Mapping the file.
+	double cache = 0.0; ///< Looking up the cache, all following phases are skipped on success.
+	double decoding = 0.0;
+	double tempos = 0.0;
+	double notes = 0.0;
+	double merging = 0.0;
+	double finalizing = 0.0; ///< Pedals normalization, timelines and duration.
+	unsigned int threadCount = 1;
+};
+
 class MIDIFile {
 
 public:
 	
 	MIDIFile();
 	
-	MIDIFile(const std::string & filePath);
+	MIDIFile(const std::string & filePath, const MIDILoadOptions & options = MIDILoadOptions());
+
+	/// Empty file, to be filled progressively with appendStream.
+	explicit MIDIFile(const MIDIHeader & header);
+
+	/// Check and parse the file header, throws on invalid or unsupported files.
+	static MIDIHeader readHeader(const MIDISpan & buffer, const std::string & filePath);
+
+	/// Add notes and pedals decoded by a stream loader, and assign their sets.
+	void appendStream(const MIDIStreamBatch & batch, const SetOptions & options);
+
+	/// Normalize pedals and rebuild timelines once the stream is complete.
+	void finalizeStream();
+
+	/// Path of the cache file for a source file content, empty if the cache is disabled.
+	static std::string cachePath(const MIDISpan & buffer, const MIDILoadOptions & options);
+
+	/// Load notes, pedals and tempos from a cache file, return false if it is missing, outdated or invalid.
+	bool loadCache(const std::string & path);
+
+	/// Save notes, pedals and tempos once they have been extracted.
+	bool saveCache(const std::string & path) const;
 
 	void updateSets(const SetOptions & options);
 
 	void print() const;
 
-	void getNotes(std::vector<MIDINote>& notes, NoteType type, const FilterOptions& filter, size_t track) const;
+	void getNotes(std::vector<MIDINote>& notes, NoteType type, const FilterOptions& filter, size_t track, size_t first = 0) const;
+
+	/// Direct access to the notes of a track, without conversion.
+	const NoteStore & notes(size_t track) const;
+
+	const std::vector<MIDIPedal> & pedals(size_t track) const;
 	
-	void getNotesActive(ActiveNotesArray& actives, double time, const FilterOptions& filter, size_t track) const;
+	void getNotesActive(ActiveNotesArray& actives, ActiveNotesArray& started, NoteCursor& cursor, double time, const FilterOptions& filter, size_t track) const;
 
 	void getPedalsActive(float &damper, float &sostenuto, float &soft, float &expression, double time, size_t track) const;
 
+	void getPedalsActive(float &damper, float &sostenuto, float &soft, float &expression, double startTime, double endTime, size_t track) const;
+
 	const double & signature() const { return _signature; }
 	
 	const double & secondsPerMeasure() const { return _secondsPerMeasure; }
@@ -33,11 +92,16 @@ public:
 
 	const int & tracksCount() const { return _trackCount; }
 
+	const MIDILoadStats & loadStats() const { return _loadStats; }
+
 private:
 
 	void populateTemposAndSignature();
 
-	void mergeTracks();
+	void mergeTracks(unsigned int threadCount);
+
+	/// Extend the duration to cover the given notes.
+	void updateDuration(const NoteStore & notes);
 
 	MIDIType _format = MIDIType::singleTrack;
 	uint16_t _unitsPerFrame = 1;
@@ -50,7 +114,8 @@ private:
 	int _trackCount = 0;
 
 	std::vector<MIDITrack> _tracks;
-	std::vector<MIDITempo> _tempos;
+	std::shared_ptr<const TempoMap> _tempoMap = std::make_shared<const TempoMap>();
+	MIDILoadStats _loadStats;
 
 };
 
@@ -0,0 +1,72 @@
+#include "MIDIInputQueue.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+
+MIDIInputQueue::MIDIInputQueue(size_t capacity){
+	size_t size = 1;
+	while(size < capacity){
+		size *= 2;
+	}
+	_events.resize(size);
+	_mask = size - 1;
+}
+
+bool MIDIInputQueue::push(const uint8_t* data, size_t size, double timestamp){
+	_received.fetch_add(1, std::memory_order_relaxed);
+	if(size > MIDI_INPUT_EVENT_SIZE){
+		_oversized.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	const size_t head = _head.load(std::memory_order_relaxed);
+	if(head - _tail.load(std::memory_order_acquire) > _mask){
+		_dropped.fetch_add(1, std::memory_order_relaxed);
+		return false;
+	}
+	MIDIInputEvent & event = _events[head & _mask];
+	event.timestamp = timestamp;
+	event.size = uint32_t(size);
+	if(size != 0){
+		std::memcpy(event.bytes.data(), data, size);
+	}
+	// Publish the event once written.
+	_head.store(head + 1, std::memory_order_release);
+	return true;
+}
+
+bool MIDIInputQueue::full() const {
+	return _head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire) > _mask;
+}
+
+bool MIDIInputQueue::pop(MIDIInputEvent & event){
+	const size_t tail = _tail.load(std::memory_order_relaxed);
+	const size_t head = _head.load(std::memory_order_acquire);
+	if(tail == head){
+		return false;
+	}
+	_peak = (std::max)(_peak, head - tail);
+	event = _events[tail & _mask];
+	// Release the slot once read.
+	_tail.store(tail + 1, std::memory_order_release);
+	return true;
+}
+
+void MIDIInputQueue::clear(){
+	_tail.store(_head.load(std::memory_order_acquire), std::memory_order_release);
+}
+
+MIDIInputQueue::Stats MIDIInputQueue::stats() const {
+	Stats stats;
+	stats.received = _received.load(std::memory_order_relaxed);
+	stats.dropped = _dropped.load(std::memory_order_relaxed);
+	stats.oversized = _oversized.load(std::memory_order_relaxed);
+	stats.peak = _peak;
+	stats.capacity = _events.size();
+	return stats;
+}
+
+double MIDIInputQueue::now(){
+	const auto time = std::chrono::steady_clock::now().time_since_epoch();
+	return std::chrono::duration<double>(time).count();
+}
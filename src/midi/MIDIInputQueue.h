@@ -0,0 +1,70 @@
+#ifndef MIDI_INPUT_QUEUE_H
+#define MIDI_INPUT_QUEUE_H
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+// Longest message stored in the queue, longer ones are dropped.
+#define MIDI_INPUT_EVENT_SIZE 12
+
+// A message received from a device, stored without allocation.
+struct MIDIInputEvent {
+	double timestamp = 0.0; ///< Arrival time in seconds, see MIDIInputQueue::now.
+	uint32_t size = 0;
+	std::array<uint8_t, MIDI_INPUT_EVENT_SIZE> bytes;
+};
+
+// Bounded lock-free queue between the thread receiving messages and the render thread.
+// Only one thread can push, and only one thread can pop.
+class MIDIInputQueue {
+public:
+
+	struct Stats {
+		uint64_t received = 0;
+		uint64_t dropped = 0; ///< The queue was full.
+		uint64_t oversized = 0; ///< The message was too long.
+		size_t peak = 0; ///< Most events pending at once, as seen by the consumer.
+		size_t capacity = 0;
+	};
+
+	/// The capacity is rounded up to a power of two.
+	explicit MIDIInputQueue(size_t capacity);
+
+	/// Producer side, return false if the message was dropped.
+	bool push(const uint8_t* data, size_t size, double timestamp);
+
+	/// Producer side, return true if a message pushed now would be dropped.
+	bool full() const;
+
+	/// Consumer side, return false if the queue is empty.
+	bool pop(MIDIInputEvent & event);
+
+	/// Consumer side, discard all pending events.
+	void clear();
+
+	/// Consumer side.
+	Stats stats() const;
+
+	/// Current time in seconds on the clock used for timestamps.
+	static double now();
+
+	MIDIInputQueue(const MIDIInputQueue&) = delete;
+	MIDIInputQueue& operator=(const MIDIInputQueue&) = delete;
+
+private:
+
+	std::vector<MIDIInputEvent> _events;
+	size_t _mask = 0;
+	// Keep the producer and consumer positions on separate cache lines.
+	alignas(64) std::atomic<size_t> _head{0}; ///< Next slot to write, only modified by the producer.
+	alignas(64) std::atomic<size_t> _tail{0}; ///< Next slot to read, only modified by the consumer.
+	alignas(64) std::atomic<uint64_t> _received{0};
+	std::atomic<uint64_t> _dropped{0};
+	std::atomic<uint64_t> _oversized{0};
+	size_t _peak = 0;
+};
+
+#endif // MIDI_INPUT_QUEUE_H
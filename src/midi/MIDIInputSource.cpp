@@ -0,0 +1,137 @@
+#include "MIDIInputSource.h"
+#include "MIDIFile.h"
+#include "../rendering/FilterOptions.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <random>
+#include <sstream>
+
+// Longest sleep between two checks for a stop request, in seconds.
+#define SOURCE_MAX_WAIT 0.01
+// Time to wait for the consumer when the queue is full, in seconds.
+#define SOURCE_FULL_WAIT 0.001
+
+MIDIThreadedSource::~MIDIThreadedSource(){
+	stop();
+}
+
+bool MIDIThreadedSource::start(MIDIInputQueue & queue){
+	stop();
+	_stop = false;
+	_thread = std::thread(&MIDIThreadedSource::run, this, std::ref(queue));
+	return true;
+}
+
+void MIDIThreadedSource::stop(){
+	_stop = true;
+	if(_thread.joinable()){
+		_thread.join();
+	}
+}
+
+MIDIReplaySource::MIDIReplaySource(const std::string & filePath, double speed) : _speed((std::max)(speed, 0.01)) {
+	MIDILoadOptions options;
+	options.releaseEvents = true;
+	options.selectiveDecode = true;
+	const MIDIFile file(filePath, options);
+
+	std::vector<MIDINote> notes;
+	file.getNotes(notes, NoteType::ALL, FilterOptions(), 0);
+	const std::vector<MIDIPedal> & pedals = file.pedals(0);
+	_messages.reserve(2 * (notes.size() + pedals.size()));
+
+	for(const MIDINote & note : notes){
+		const uint8_t channel = uint8_t(note.channel & 0xF);
+		const uint8_t key = uint8_t(note.note & 0x7F);
+		const uint8_t velocity = uint8_t(clamp<int>(int(note.velocity), 1, 127));
+		_messages.push_back({note.start, {uint8_t(0x90 | channel), key, velocity}});
+		_messages.push_back({note.start + note.duration, {uint8_t(0x80 | channel), key, 0}});
+	}
+	for(const MIDIPedal & pedal : pedals){
+		const uint8_t value = uint8_t(clamp<int>(int(std::round(pedal.velocity * 127.0f)), 1, 127));
+		_messages.push_back({pedal.start, {0xB0, uint8_t(pedal.type), value}});
+		_messages.push_back({pedal.start + pedal.duration, {0xB0, uint8_t(pedal.type), 0}});
+	}
+	// Releases first at a given time, so that a key released and pressed again at once is restarted.
+	std::stable_sort(_messages.begin(), _messages.end(), [](const Message & a, const Message & b){
+		const bool aRelease = (a.bytes[0] & 0xF0) == 0x80 || a.bytes[2] == 0;
+		const bool bRelease = (b.bytes[0] & 0xF0) == 0x80 || b.bytes[2] == 0;
+		return a.time < b.time || (a.time == b.time && aRelease && !bRelease);
+	});
+
+	const std::string::size_type separator = filePath.find_last_of("/\\");
+	std::stringstream name;
+	name << "Replay of " << (separator == std::string::npos ? filePath : filePath.substr(separator + 1)) << " (" << _speed << "x)";
+	_name = name.str();
+}
+
+MIDIReplaySource::~MIDIReplaySource(){
+	stop();
+}
+
+void MIDIReplaySource::run(MIDIInputQueue & queue){
+	const auto startTime = std::chrono::steady_clock::now();
+	size_t next = 0;
+	while(!_stop && next < _messages.size()){
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count() * _speed;
+		for(; next < _messages.size() && _messages[next].time <= elapsed; ++next){
+			// Unlike a device, a replay can wait for the consumer instead of losing messages.
+			while(queue.full()){
+				if(_stop){
+					return;
+				}
+				std::this_thread::sleep_for(std::chrono::duration<double>(SOURCE_FULL_WAIT));
+			}
+			queue.push(_messages[next].bytes.data(), _messages[next].bytes.size(), MIDIInputQueue::now());
+		}
+		if(next < _messages.size()){
+			const double wait = (std::min)((_messages[next].time - elapsed) / _speed, double(SOURCE_MAX_WAIT));
+			std::this_thread::sleep_for(std::chrono::duration<double>(wait));
+		}
+	}
+}
+
+MIDIStressSource::MIDIStressSource(double messagesPerSecond, unsigned int seed) : _rate((std::max)(messagesPerSecond, 1.0)), _seed(seed) {
+	std::stringstream name;
+	name << "Stress test (" << _rate << " messages/s)";
+	_name = name.str();
+}
+
+MIDIStressSource::~MIDIStressSource(){
+	stop();
+}
+
+void MIDIStressSource::run(MIDIInputQueue & queue){
+	std::mt19937 random(_seed);
+	std::array<bool, 128> pressed;
+	pressed.fill(false);
+
+	const auto startTime = std::chrono::steady_clock::now();
+	uint64_t sent = 0;
+	while(!_stop){
+		const double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		const uint64_t due = uint64_t(elapsed * _rate);
+		for(; sent < due; ++sent){
+			std::array<uint8_t, 3> bytes;
+			const uint8_t channel = uint8_t(random() % 16);
+			if(random() % 8 == 0){
+				// Pedals and expression changes.
+				const uint8_t controller = (random() % 2 == 0) ? DAMPER : EXPRESSION;
+				bytes = {uint8_t(0xB0 | channel), controller, uint8_t(random() % 128)};
+			} else {
+				// Alternate presses and releases on the piano range.
+				const uint8_t key = uint8_t(21 + random() % 88);
+				if(pressed[key]){
+					bytes = {uint8_t(0x80 | channel), key, 0};
+				} else {
+					bytes = {uint8_t(0x90 | channel), key, uint8_t(1 + random() % 127)};
+				}
+				pressed[key] = !pressed[key];
+			}
+			queue.push(bytes.data(), bytes.size(), MIDIInputQueue::now());
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+}
@@ -0,0 +1,96 @@
+#ifndef MIDI_INPUT_SOURCE_H
+#define MIDI_INPUT_SOURCE_H
+
+#include "MIDIInputQueue.h"
+
+#include <array>
+#include <atomic>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Producer of live messages, pushed to a queue as they are received.
+class MIDIInputSource {
+public:
+
+	virtual ~MIDIInputSource() = default;
+
+	/// Start pushing messages to the queue, return false if the source couldn't start.
+	virtual bool start(MIDIInputQueue & queue) = 0;
+
+	/// Stop pushing messages, the queue won't be accessed anymore once this returns.
+	virtual void stop() = 0;
+
+	/// Name displayed in the interface.
+	virtual const std::string & name() const = 0;
+};
+
+// Source pushing messages from a dedicated thread.
+class MIDIThreadedSource : public MIDIInputSource {
+public:
+
+	~MIDIThreadedSource() override;
+
+	bool start(MIDIInputQueue & queue) override;
+
+	void stop() override;
+
+protected:
+
+	/// Push messages until stopped.
+	virtual void run(MIDIInputQueue & queue) = 0;
+
+	std::atomic<bool> _stop{false};
+
+private:
+
+	std::thread _thread;
+};
+
+// Replay the notes and pedals of a MIDI file as if they were played live.
+class MIDIReplaySource : public MIDIThreadedSource {
+public:
+
+	/// Throw if the file can't be loaded.
+	MIDIReplaySource(const std::string & filePath, double speed);
+
+	~MIDIReplaySource() override;
+
+	const std::string & name() const override { return _name; }
+
+	size_t messagesCount() const { return _messages.size(); }
+
+private:
+
+	struct Message {
+		double time;
+		std::array<uint8_t, 3> bytes;
+	};
+
+	void run(MIDIInputQueue & queue) override;
+
+	std::vector<Message> _messages; ///< Sorted by time.
+	std::string _name;
+	double _speed;
+};
+
+// Generate random notes and controllers at a fixed rate.
+class MIDIStressSource : public MIDIThreadedSource {
+public:
+
+	MIDIStressSource(double messagesPerSecond, unsigned int seed);
+
+	~MIDIStressSource() override;
+
+	const std::string & name() const override { return _name; }
+
+private:
+
+	void run(MIDIInputQueue & queue) override;
+
+	std::string _name;
+	double _rate;
+	unsigned int _seed;
+};
+
+#endif
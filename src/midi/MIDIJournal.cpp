@@ -0,0 +1,258 @@
+#include "MIDIJournal.h"
+#include "MIDIBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+// Journal files start with a magic number and a version.
+#define MIDI_JOURNAL_MAGIC "MVJL"
+#define MIDI_JOURNAL_VERSION 1
+#define MIDI_JOURNAL_HEADER_SIZE 8
+// Ticks per quarter note in exported files.
+#define MIDI_JOURNAL_UNITS_PER_QUARTER 960
+
+// Each record is the time as a double, the message size on one byte, then the message bytes.
+
+static void writeBig(std::vector<uint8_t> & data, uint32_t value, int size){
+	for(int i = size - 1; i >= 0; --i){
+		data.push_back(uint8_t((value >> (8 * i)) & 0xFF));
+	}
+}
+
+static void writeVarLen(std::vector<uint8_t> & data, uint32_t value){
+	uint8_t bytes[5];
+	int count = 0;
+	bytes[count++] = value & 0x7F;
+	while(value >>= 7){
+		bytes[count++] = uint8_t((value & 0x7F) | 0x80);
+	}
+	while(count > 0){
+		data.push_back(bytes[--count]);
+	}
+}
+
+MIDIJournal::~MIDIJournal(){
+	// Keep the journal on disk, it is only deleted explicitly.
+	if(_file.is_open()){
+		_file.close();
+	}
+}
+
+bool MIDIJournal::open(const std::string & filePath){
+	_file = MIDIBuffer::openOutput(filePath);
+	if(!_file.is_open()){
+		std::cerr << "[WARNING]: Unable to create live journal at " << filePath << ", the session will only be kept in memory." << std::endl;
+		return false;
+	}
+	uint8_t header[MIDI_JOURNAL_HEADER_SIZE];
+	const uint32_t version = MIDI_JOURNAL_VERSION;
+	std::memcpy(header, MIDI_JOURNAL_MAGIC, 4);
+	std::memcpy(header + 4, &version, sizeof(uint32_t));
+	_file.write(reinterpret_cast<const char*>(header), MIDI_JOURNAL_HEADER_SIZE);
+	_file.flush();
+	if(_file.fail()){
+		std::cerr << "[WARNING]: Unable to write live journal at " << filePath << ", the session will only be kept in memory." << std::endl;
+		_file.close();
+		MIDIBuffer::remove(filePath);
+		return false;
+	}
+	_path = filePath;
+	return true;
+}
+
+void MIDIJournal::append(double time, const uint8_t* data, size_t size){
+	if(size > 0xFF){
+		return;
+	}
+	const size_t recordSize = sizeof(double) + 1 + size;
+	if(_blocks.empty() || _blocks.back().data.size() + recordSize > MIDI_JOURNAL_BLOCK_SIZE){
+		_blocks.emplace_back();
+		_blocks.back().data.reserve(MIDI_JOURNAL_BLOCK_SIZE);
+	}
+	// Messages are exported in order, without sorting.
+	_lastTime = (std::max)(_lastTime, time);
+
+	std::vector<uint8_t> & block = _blocks.back().data;
+	const size_t pos = block.size();
+	block.resize(pos + recordSize);
+	std::memcpy(block.data() + pos, &_lastTime, sizeof(double));
+	block[pos + sizeof(double)] = uint8_t(size);
+	if(size != 0){
+		std::memcpy(block.data() + pos + sizeof(double) + 1, data, size);
+	}
+	++_messagesCount;
+}
+
+void MIDIJournal::flush(){
+	if(!_file.is_open()){
+		return;
+	}
+	size_t written = 0;
+	for(const Block & block : _blocks){
+		const size_t count = block.data.size() - block.flushed;
+		if(count != 0){
+			_file.write(reinterpret_cast<const char*>(block.data.data() + block.flushed), std::streamsize(count));
+			written += count;
+		}
+	}
+	if(written == 0){
+		return;
+	}
+	_file.flush();
+	if(_file.fail()){
+		// Keep the remaining messages in memory, the journal content up to now is still valid.
+		std::cerr << "[ERROR]: Unable to write to live journal at " << _path << ", the rest of the session will only be kept in memory." << std::endl;
+		_file.close();
+		return;
+	}
+	for(Block & block : _blocks){
+		block.flushed = block.data.size();
+	}
+	_fileSize += written;
+	// Release completed blocks, the last one is still being filled.
+	while(_blocks.size() > 1){
+		_blocks.pop_front();
+	}
+}
+
+void MIDIJournal::discard(){
+	if(_file.is_open()){
+		_file.close();
+	}
+	if(!_path.empty()){
+		MIDIBuffer::remove(_path);
+	}
+	_path.clear();
+	_fileSize = 0;
+}
+
+bool MIDIJournal::write(std::ostream & output, int tempo, int signatureNum, int signatureDenom) const {
+	std::vector<MIDISpan> spans;
+	// Messages already flushed are read back from the journal file.
+	MIDIBuffer journal;
+	if(_fileSize != 0){
+		if(!journal.load(_path) || journal.span().size < MIDI_JOURNAL_HEADER_SIZE + _fileSize){
+			std::cerr << "[ERROR]: Unable to read live journal at " << _path << std::endl;
+			return false;
+		}
+		spans.emplace_back(journal.span().data + MIDI_JOURNAL_HEADER_SIZE, _fileSize);
+	}
+	for(const Block & block : _blocks){
+		spans.emplace_back(block.data.data() + block.flushed, block.data.size() - block.flushed);
+	}
+	return writeFile(output, spans, tempo, signatureNum, signatureDenom);
+}
+
+bool MIDIJournal::recover(const std::string & journalPath, const std::string & outputPath){
+	MIDIBuffer journal;
+	if(!journal.load(journalPath)){
+		std::cerr << "[ERROR]: Unable to read live journal at " << journalPath << std::endl;
+		return false;
+	}
+	const MIDISpan buffer = journal.span();
+	uint32_t version = 0;
+	if(buffer.size >= MIDI_JOURNAL_HEADER_SIZE){
+		std::memcpy(&version, buffer.data + 4, sizeof(uint32_t));
+	}
+	if(buffer.size < MIDI_JOURNAL_HEADER_SIZE || std::memcmp(buffer.data, MIDI_JOURNAL_MAGIC, 4) != 0 || version != MIDI_JOURNAL_VERSION){
+		std::cerr << "[ERROR]: Unsupported live journal at " << journalPath << std::endl;
+		return false;
+	}
+	std::ofstream output = MIDIBuffer::openOutput(outputPath);
+	if(!output.is_open()){
+		std::cerr << "[ERROR]: Unable to write MIDI file at " << outputPath << std::endl;
+		return false;
+	}
+	// The tempo and signature are not journaled, use the defaults.
+	const std::vector<MIDISpan> spans = { MIDISpan(buffer.data + MIDI_JOURNAL_HEADER_SIZE, buffer.size - MIDI_JOURNAL_HEADER_SIZE) };
+	const bool success = writeFile(output, spans, 500000, 4, 4);
+	output.close();
+	return success && !output.fail();
+}
+
+bool MIDIJournal::writeFile(std::ostream & output, const std::vector<MIDISpan> & spans, int tempo, int signatureNum, int signatureDenom){
+	const double unitsPerSecond = double(MIDI_JOURNAL_UNITS_PER_QUARTER) * 1000000.0 / double(tempo);
+
+	std::vector<uint8_t> data;
+	data.reserve(MIDI_JOURNAL_BLOCK_SIZE);
+	// Single track file.
+	data.insert(data.end(), {'M', 'T', 'h', 'd'});
+	writeBig(data, 6, 4);
+	writeBig(data, 0, 2);
+	writeBig(data, 1, 2);
+	writeBig(data, MIDI_JOURNAL_UNITS_PER_QUARTER, 2);
+	data.insert(data.end(), {'M', 'T', 'r', 'k'});
+	const std::streampos lengthPos = output.tellp();
+	if(lengthPos < 0){
+		std::cerr << "[ERROR]: Unable to write MIDI file to a non seekable stream." << std::endl;
+		return false;
+	}
+	// The track length is patched once all events are written.
+	const std::streamoff lengthOffset = std::streamoff(data.size());
+	writeBig(data, 0, 4);
+	const size_t headerSize = data.size();
+
+	// Set an initial tempo/signature at t=0 so that the first message delta is correct.
+	int signaturePower = 0;
+	while((1 << signaturePower) < signatureDenom && signaturePower < 8){
+		++signaturePower;
+	}
+	data.insert(data.end(), {0x00, 0xFF, 0x51, 0x03});
+	writeBig(data, uint32_t(tempo), 3);
+	data.insert(data.end(), {0x00, 0xFF, 0x58, 0x04, uint8_t(signatureNum), uint8_t(signaturePower), 24, 8});
+	data.insert(data.end(), {0x00, 0xFF, 0x59, 0x02, 0x01, 0x00});
+
+	size_t trackSize = 0;
+	uint64_t previousTicks = 0;
+	for(const MIDISpan & span : spans){
+		size_t pos = 0;
+		// A truncated record at the end of an interrupted journal is ignored.
+		while(pos + sizeof(double) + 1 <= span.size){
+			double time;
+			std::memcpy(&time, span.data + pos, sizeof(double));
+			const size_t size = span[pos + sizeof(double)];
+			const uint8_t* message = span.data + pos + sizeof(double) + 1;
+			if(pos + sizeof(double) + 1 + size > span.size){
+				break;
+			}
+			pos += sizeof(double) + 1 + size;
+
+			// Only channel messages can be stored as is.
+			if(size == 0 || message[0] < 0x80 || message[0] >= 0xF0){
+				continue;
+			}
+			const uint8_t kind = message[0] & 0xF0;
+			const size_t length = (kind == 0xC0 || kind == 0xD0) ? 2 : 3;
+			if(size < length){
+				continue;
+			}
+			const uint64_t ticks = (std::max)(uint64_t(std::llround((std::max)(time, 0.0) * unitsPerSecond)), previousTicks);
+			const uint32_t delta = uint32_t((std::min)(ticks - previousTicks, uint64_t(0x0FFFFFFF)));
+			writeVarLen(data, delta);
+			data.insert(data.end(), message, message + length);
+			previousTicks += delta;
+
+			if(data.size() >= MIDI_JOURNAL_BLOCK_SIZE){
+				output.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+				trackSize += data.size();
+				data.clear();
+			}
+		}
+	}
+	data.insert(data.end(), {0x00, 0xFF, 0x2F, 0x00});
+	output.write(reinterpret_cast<const char*>(data.data()), std::streamsize(data.size()));
+	trackSize += data.size();
+
+	const std::streampos endPos = output.tellp();
+	std::vector<uint8_t> length;
+	writeBig(length, uint32_t(trackSize - headerSize), 4);
+	output.seekp(lengthPos + lengthOffset);
+	output.write(reinterpret_cast<const char*>(length.data()), std::streamsize(length.size()));
+	output.seekp(endPos);
+	if(output.fail()){
+		std::cerr << "[ERROR]: Unable to write MIDI file." << std::endl;
+		return false;
+	}
+	return true;
+}
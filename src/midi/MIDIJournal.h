@@ -0,0 +1,68 @@
+#ifndef MIDI_JOURNAL_H
+#define MIDI_JOURNAL_H
+
+#include "MIDIUtils.h"
+
+#include <deque>
+#include <fstream>
+#include <string>
+#include <vector>
+
+// Size of the blocks messages are packed in.
+#define MIDI_JOURNAL_BLOCK_SIZE 65536
+// Extension of journal files.
+#define MIDI_JOURNAL_EXTENSION ".mvjournal"
+
+// Append-only log of the messages received during a live session.
+// Messages are packed in fixed-size blocks. When backed by a file, each flush appends the new
+// messages to it and completed blocks are released, so that an interrupted session can be recovered.
+class MIDIJournal {
+public:
+
+	MIDIJournal() = default;
+
+	~MIDIJournal();
+
+	/// Start writing to a new journal file, return false if it couldn't be created (the journal then stays in memory).
+	bool open(const std::string & filePath);
+
+	/// Append a message received at the given time in seconds. Times are clamped to be non-decreasing.
+	void append(double time, const uint8_t* data, size_t size);
+
+	/// Write new messages to the journal file and release completed blocks.
+	void flush();
+
+	/// Close and delete the journal file, once the session ended normally.
+	void discard();
+
+	size_t messagesCount() const { return _messagesCount; }
+
+	const std::string & path() const { return _path; }
+
+	/// Write all messages as a single track MIDI file, in one pass.
+	bool write(std::ostream & output, int tempo, int signatureNum, int signatureDenom) const;
+
+	/// Convert a journal to a MIDI file with the default tempo and signature.
+	static bool recover(const std::string & journalPath, const std::string & outputPath);
+
+	MIDIJournal(const MIDIJournal&) = delete;
+	MIDIJournal& operator=(const MIDIJournal&) = delete;
+
+private:
+
+	struct Block {
+		std::vector<uint8_t> data;
+		size_t flushed = 0; ///< Bytes already written to the journal file.
+	};
+
+	static bool writeFile(std::ostream & output, const std::vector<MIDISpan> & spans, int tempo, int signatureNum, int signatureDenom);
+
+	std::deque<Block> _blocks;
+	std::ofstream _file;
+	std::string _path;
+	size_t _fileSize = 0; ///< Bytes of messages stored in the journal file.
+	size_t _messagesCount = 0;
+	double _lastTime = 0.0;
+};
+
+#endif
@@ -0,0 +1,188 @@
+#include "MIDIStream.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <queue>
+
+// Number of events decoded between two publications.
+#define STREAM_BATCH_EVENTS 65536
+
+MIDIStreamLoader::MIDIStreamLoader(const std::string & filePath, const MIDILoadOptions & options){
+	if(!_buffer.load(filePath)) {
+		std::cerr << "[ERROR]: Couldn't find file at path " << filePath << std::endl;
+		throw "BadInput";
+	}
+	_header = MIDIFile::readHeader(_buffer.span(), filePath);
+	_thread = std::thread(&MIDIStreamLoader::run, this, options.notePairing);
+}
+
+MIDIStreamLoader::~MIDIStreamLoader(){
+	_stop = true;
+	if(_thread.joinable()){
+		_thread.join();
+	}
+}
+
+bool MIDIStreamLoader::poll(MIDIStreamBatch & batch){
+	std::lock_guard<std::mutex> lock(_mutex);
+	if(!_updated){
+		return false;
+	}
+	batch.notes.clear();
+	batch.pedals.clear();
+	std::swap(batch.notes, _pending.notes);
+	std::swap(batch.pedals, _pending.pedals);
+	batch.signature = _pending.signature;
+	batch.secondsPerMeasure = _pending.secondsPerMeasure;
+	batch.complete = _pending.complete;
+	_updated = false;
+	return true;
+}
+
+void MIDIStreamLoader::wait(){
+	if(_thread.joinable()){
+		_thread.join();
+	}
+}
+
+void MIDIStreamLoader::run(NotePairing pairing){
+	const auto startTime = std::chrono::steady_clock::now();
+	const MIDISpan buffer = _buffer.span();
+
+	struct TrackState {
+		size_t pos;
+		size_t end;
+		size_t units;
+		uint8_t previousFirstByte;
+		EventPairing events;
+	};
+	std::vector<TrackState> tracks;
+	tracks.reserve(_header.tracksCount);
+
+	// Next event of each track, ordered by time then by track.
+	typedef std::pair<size_t, size_t> NextEvent;
+	std::priority_queue<NextEvent, std::vector<NextEvent>, std::greater<NextEvent>> queue;
+
+	size_t pos = 14;
+	for(size_t trackId = 0; trackId < _header.tracksCount; ++trackId){
+		const size_t nextPos = MIDITrack::skipTrack(buffer, pos);
+		if(nextPos == 3){
+			std::cerr << "[ERROR]: Missing track." << std::endl;
+		}
+		tracks.push_back({pos + 8, (std::min)(nextPos, buffer.size), 0, 0, EventPairing(pairing)});
+		TrackState & track = tracks.back();
+		if(nextPos != 3 && track.pos < track.end){
+			track.units = uint32_t(readVarLen(buffer, track.pos));
+			queue.emplace(track.units, trackId);
+		}
+		pos = nextPos;
+	}
+
+	TempoMap tempoMap({}, _header.unitsPerQuarterNote);
+	TempoMap::Cursor tempoCursor = tempoMap.cursor();
+	double signature = 4.0/4.0;
+	uint32_t currentTicks = 0;
+
+	std::vector<uint8_t> payloads;
+	NoteStore notes;
+	std::vector<MIDIPedal> pedals;
+	size_t eventCount = 0;
+	size_t notesCount = 0;
+
+	while(!queue.empty() && !_stop){
+		const size_t trackId = queue.top().second;
+		queue.pop();
+		TrackState & track = tracks[trackId];
+		currentTicks = uint32_t(track.units);
+
+		// Only tempos, signatures, notes and pedals are decoded, other events are skipped.
+		payloads.clear();
+		MIDIEvent event;
+		if(!MIDIEvent::readEvent(buffer, track.pos, 0, track.previousFirstByte, payloads, true, event)){
+			// Nothing to process.
+		} else if(event.category == EventCategory::META){
+			const uint8_t* data = payloads.data() + event.payload.offset;
+			if(event.type == setTempo && event.payload.length >= 3){
+				const unsigned int tempo = (data[0] << 16) | (data[1] << 8) | data[2];
+				tempoMap.append(currentTicks, tempo);
+			} else if(event.type == timeSignature && event.payload.length >= 2){
+				signature = double(data[0]) / double(std::pow(2,data[1]));
+			}
+		} else {
+			track.events.process(event, currentTicks, tempoCursor, (unsigned int)trackId, notes, pedals);
+		}
+
+		if(track.pos < track.end){
+			track.units += uint32_t(readVarLen(buffer, track.pos));
+			queue.emplace(track.units, trackId);
+		}
+
+		++eventCount;
+		if(eventCount % STREAM_BATCH_EVENTS == 0){
+			// Events still waiting for their end and events to come all start after the watermark.
+			uint32_t watermark = currentTicks;
+			for(const auto & other : tracks){
+				watermark = (std::min)(watermark, other.events.earliestOpenEvent());
+			}
+			notesCount += publish(notes, pedals, watermark, tempoMap, signature, false);
+		}
+	}
+	if(_stop){
+		return;
+	}
+	notesCount += publish(notes, pedals, currentTicks, tempoMap, signature, true);
+
+	const auto endTime = std::chrono::steady_clock::now();
+	const double duration = std::chrono::duration<double, std::milli>(endTime - startTime).count();
+	std::cout << "[INFO]: Streamed " << notesCount << " notes from " << tracks.size() << " tracks in " << duration << "ms." << std::endl;
+}
+
+size_t MIDIStreamLoader::publish(NoteStore & notes, std::vector<MIDIPedal> & pedals, uint32_t watermark, const TempoMap & tempoMap, double signature, bool complete){
+	// Notes are completed in end order, keep the ones that could still be preceded by a future note.
+	std::vector<uint32_t> ready;
+	std::vector<uint32_t> waiting;
+	// Order simultaneous notes by track then extraction order, as when merging tracks in MIDIFile.
+	std::vector<uint32_t> order(notes.size());
+	for(size_t i = 0; i < order.size(); ++i){
+		order[i] = uint32_t(i);
+	}
+	std::stable_sort(order.begin(), order.end(), [&notes](uint32_t a, uint32_t b){
+		const uint32_t startA = notes.startTicks(a);
+		const uint32_t startB = notes.startTicks(b);
+		return startA < startB || (startA == startB && notes.track(a) < notes.track(b));
+	});
+	for(const uint32_t id : order){
+		if(complete || notes.startTicks(id) < watermark){
+			ready.push_back(id);
+		} else {
+			waiting.push_back(id);
+		}
+	}
+	const double watermarkTime = complete ? std::numeric_limits<double>::infinity() : tempoMap.secondsAt(watermark);
+	const auto pedalsEnd = std::stable_partition(pedals.begin(), pedals.end(), [watermarkTime](const MIDIPedal & pedal){
+		return pedal.start < watermarkTime;
+	});
+	std::stable_sort(pedals.begin(), pedalsEnd, [](const MIDIPedal & a, const MIDIPedal & b){
+		return a.start < b.start;
+	});
+	// Published notes can't end after the current time, they are covered by the current tempos.
+	const std::shared_ptr<const TempoMap> tempos = std::make_shared<const TempoMap>(tempoMap);
+
+	{
+		std::lock_guard<std::mutex> lock(_mutex);
+		_pending.notes.append(notes, ready);
+		_pending.notes.setTempoMap(tempos);
+		_pending.pedals.insert(_pending.pedals.end(), pedals.begin(), pedalsEnd);
+		_pending.signature = signature;
+		_pending.secondsPerMeasure = computeMeasureDuration(tempoMap.tempos()[0].tempo, signature);
+		_pending.complete = complete;
+		_updated = true;
+	}
+	NoteStore remaining;
+	remaining.append(notes, waiting);
+	std::swap(notes, remaining);
+	pedals.erase(pedals.begin(), pedalsEnd);
+	return ready.size();
+}
@@ -0,0 +1,61 @@
+#ifndef MIDI_STREAM_H
+#define MIDI_STREAM_H
+
+#include "MIDIFile.h"
+#include "MIDIBuffer.h"
+
+#include <thread>
+#include <mutex>
+#include <atomic>
+
+// Notes and pedals decoded since the previous poll.
+struct MIDIStreamBatch {
+	NoteStore notes; ///< Sorted by start, starting after all previously received notes.
+	std::vector<MIDIPedal> pedals; ///< Sorted by start, with raw velocities.
+	double signature = 4.0/4.0;
+	double secondsPerMeasure = 1.0;
+	bool complete = false; ///< All events have been decoded.
+};
+
+// Decode a MIDI file on a background thread, merging tracks in time order.
+// Notes are published as soon as no earlier note can still be found, so that playback can start
+// before the end of the file is reached.
+class MIDIStreamLoader {
+
+public:
+
+	/// Check the file header and start decoding, throws on invalid files.
+	MIDIStreamLoader(const std::string & filePath, const MIDILoadOptions & options);
+
+	~MIDIStreamLoader();
+
+	/// Retrieve notes and pedals decoded since the last call, return false if there is nothing new.
+	bool poll(MIDIStreamBatch & batch);
+
+	/// Block until the whole file has been decoded.
+	void wait();
+
+	const MIDIHeader & header() const { return _header; }
+
+	MIDIStreamLoader(const MIDIStreamLoader&) = delete;
+	MIDIStreamLoader& operator=(const MIDIStreamLoader&) = delete;
+
+private:
+
+	void run(NotePairing pairing);
+
+	/// Move decoded notes and pedals starting before the watermark (in ticks) to the shared batch, return the number of notes moved.
+	size_t publish(NoteStore & notes, std::vector<MIDIPedal> & pedals, uint32_t watermark, const TempoMap & tempoMap, double signature, bool complete);
+
+	MIDIBuffer _buffer;
+	MIDIHeader _header;
+	std::thread _thread;
+
+	std::mutex _mutex;
+	MIDIStreamBatch _pending; ///< Protected by the mutex.
+	bool _updated = false; ///< Protected by the mutex.
+	std::atomic<bool> _stop{false};
+
+};
+
+#endif // MIDI_STREAM_H
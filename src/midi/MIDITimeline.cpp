@@ -0,0 +1,282 @@
+#include "MIDITimeline.h"
+
+#include <algorithm>
+#include <limits>
+#include <queue>
+#include <cmath>
+
+// Number of note starts between two checkpoints.
+#define NOTES_CHECKPOINT_INTERVAL 4096
+
+void NoteTimeline::clear(){
+	_appended = false;
+	_starts.clear();
+	_ends.clear();
+	_checkpoints.clear();
+	_checkpointsActives.clear();
+}
+
+void NoteTimeline::build(const NoteStore & notes){
+	clear();
+	const size_t count = notes.size();
+	_starts.resize(count);
+	for(size_t i = 0; i < count; ++i){
+		_starts[i] = uint32_t(i);
+	}
+	_ends = _starts;
+	// Stable, so that notes at the same time stay in file order.
+	// Ticks are ordered as seconds, and cheaper to compare.
+	std::stable_sort(_starts.begin(), _starts.end(), [&notes](uint32_t a, uint32_t b){
+		return notes.startTicks(a) < notes.startTicks(b);
+	});
+	std::stable_sort(_ends.begin(), _ends.end(), [&notes](uint32_t a, uint32_t b){
+		return notes.endTicks(a) < notes.endTicks(b);
+	});
+
+	// Sweep through starts, keeping started notes ordered by end time.
+	typedef std::pair<uint32_t, uint32_t> EndEntry;
+	std::priority_queue<EndEntry, std::vector<EndEntry>, std::greater<EndEntry>> started;
+	std::vector<uint32_t> actives;
+	size_t endPos = 0;
+
+	for(size_t startPos = 0; startPos < count; startPos += NOTES_CHECKPOINT_INTERVAL){
+		Checkpoint checkpoint;
+		// The first checkpoint covers everything before the first note.
+		checkpoint.time = startPos == 0 ? std::numeric_limits<double>::lowest() : notes.start(_starts[startPos]);
+		checkpoint.startPos = startPos;
+		const uint32_t checkpointTicks = notes.startTicks(_starts[startPos]);
+		// Notes ended strictly before the checkpoint are inactive.
+		while(endPos < count && notes.endTicks(_ends[endPos]) < checkpointTicks){
+			++endPos;
+		}
+		checkpoint.endPos = endPos;
+		while(!started.empty() && started.top().first < checkpointTicks){
+			started.pop();
+		}
+		// Copy the remaining started notes.
+		auto heap = started;
+		actives.clear();
+		while(!heap.empty()){
+			actives.push_back(heap.top().second);
+			heap.pop();
+		}
+		checkpoint.firstActive = _checkpointsActives.size();
+		checkpoint.activeCount = actives.size();
+		_checkpointsActives.insert(_checkpointsActives.end(), actives.begin(), actives.end());
+		_checkpoints.push_back(checkpoint);
+
+		// Register notes started before the next checkpoint.
+		const size_t nextPos = (std::min)(count, startPos + NOTES_CHECKPOINT_INTERVAL);
+		for(size_t pos = startPos; pos < nextPos; ++pos){
+			const uint32_t id = _starts[pos];
+			started.emplace(notes.endTicks(id), id);
+		}
+	}
+}
+
+void NoteTimeline::append(const NoteStore & notes, size_t first){
+	// Checkpoints and ends would have to be rebuilt, only keep starts.
+	if(!_appended){
+		_ends.clear();
+		_checkpoints.clear();
+		_checkpointsActives.clear();
+		_appended = true;
+	}
+	for(size_t i = first; i < notes.size(); ++i){
+		_starts.push_back(uint32_t(i));
+	}
+}
+
+void NoteTimeline::moveTo(NoteCursor & cursor, const NoteStore & notes, double time) const {
+	cursor.started.clear();
+	if(_appended){
+		const bool forward = cursor.valid && time >= cursor.time;
+		if(!forward){
+			for(auto & key : cursor.actives){
+				key.clear();
+			}
+			cursor.startPos = 0;
+		}
+		advanceAppended(cursor, notes, time, forward);
+		cursor.time = time;
+		cursor.valid = true;
+		return;
+	}
+	if(_checkpoints.empty()){
+		cursor.time = time;
+		cursor.valid = true;
+		return;
+	}
+	const bool forward = cursor.valid && time >= cursor.time;
+	bool restore = !forward;
+	if(forward){
+		// Jumping ahead over more than a checkpoint interval, restart from the closest checkpoint.
+		const size_t nextCheckpoint = cursor.startPos / NOTES_CHECKPOINT_INTERVAL + 2;
+		restore = nextCheckpoint < _checkpoints.size() && _checkpoints[nextCheckpoint].time <= time;
+	}
+	if(restore){
+		seek(cursor, notes, time);
+		// When jumping ahead, notes started between the previous time and the checkpoint are new, but not the ones before.
+		if(forward){
+			const double previousTime = cursor.time;
+			const auto firstNew = std::upper_bound(_starts.begin(), _starts.begin() + cursor.startPos, previousTime, [&notes](double t, uint32_t id){
+				return t < notes.start(id);
+			});
+			cursor.started.insert(cursor.started.end(), firstNew, _starts.begin() + cursor.startPos);
+		}
+	}
+	// All notes started after the previous position are new.
+	advance(cursor, notes, time, forward);
+	cursor.time = time;
+	cursor.valid = true;
+}
+
+void NoteTimeline::seek(NoteCursor & cursor, const NoteStore & notes, double time) const {
+	// Last checkpoint at or before the requested time (the first one is always valid).
+	const auto next = std::upper_bound(_checkpoints.begin(), _checkpoints.end(), time, [](double t, const Checkpoint & checkpoint){
+		return t < checkpoint.time;
+	});
+	const Checkpoint & checkpoint = next == _checkpoints.begin() ? _checkpoints[0] : *(next - 1);
+
+	for(auto & key : cursor.actives){
+		key.clear();
+	}
+	for(size_t i = 0; i < checkpoint.activeCount; ++i){
+		const uint32_t id = _checkpointsActives[checkpoint.firstActive + i];
+		cursor.actives[notes.key(id)].push_back(id);
+	}
+	cursor.startPos = checkpoint.startPos;
+	cursor.endPos = checkpoint.endPos;
+}
+
+void NoteTimeline::advance(NoteCursor & cursor, const NoteStore & notes, double time, bool recordStarts) const {
+	const size_t count = _starts.size();
+	// Register started notes first, so that notes starting and ending in the interval are properly removed.
+	while(cursor.startPos < count && notes.start(_starts[cursor.startPos]) <= time){
+		const uint32_t id = _starts[cursor.startPos];
+		cursor.actives[notes.key(id)].push_back(id);
+		if(recordStarts){
+			cursor.started.push_back(id);
+		}
+		++cursor.startPos;
+	}
+	while(cursor.endPos < count && notes.end(_ends[cursor.endPos]) < time){
+		const uint32_t id = _ends[cursor.endPos];
+		auto & key = cursor.actives[notes.key(id)];
+		const auto it = std::find(key.begin(), key.end(), id);
+		if(it != key.end()){
+			*it = key.back();
+			key.pop_back();
+		}
+		++cursor.endPos;
+	}
+}
+
+void NoteTimeline::advanceAppended(NoteCursor & cursor, const NoteStore & notes, double time, bool recordStarts) const {
+	// Without notes sorted by end, check active notes on each key.
+	for(auto & key : cursor.actives){
+		key.erase(std::remove_if(key.begin(), key.end(), [&notes, time](uint32_t id){
+			return notes.end(id) < time;
+		}), key.end());
+	}
+	const size_t count = _starts.size();
+	while(cursor.startPos < count && notes.start(_starts[cursor.startPos]) <= time){
+		const uint32_t id = _starts[cursor.startPos];
+		if(notes.end(id) >= time){
+			cursor.actives[notes.key(id)].push_back(id);
+		}
+		if(recordStarts){
+			cursor.started.push_back(id);
+		}
+		++cursor.startPos;
+	}
+}
+
+void PedalTimeline::build(const std::vector<MIDIPedal> & pedals, PedalType type){
+	_segments.clear();
+	std::vector<const MIDIPedal*> presses;
+	for(const auto & pedal : pedals){
+		if(pedal.type == type){
+			presses.push_back(&pedal);
+		}
+	}
+	std::stable_sort(presses.begin(), presses.end(), [](const MIDIPedal* a, const MIDIPedal* b){
+		return a->start < b->start;
+	});
+
+	// Presses still ongoing, the last one is the current value.
+	std::vector<const MIDIPedal*> stack;
+	double currentStart = 0.0;
+
+	auto emit = [this](double start, double end, float velocity){
+		if(end >= start){
+			_segments.push_back({start, end, velocity});
+		}
+	};
+	// Finish all presses ending strictly before the given time, resuming the previous ones.
+	auto finishUntil = [&stack, &currentStart, &emit](double time){
+		while(!stack.empty() && stack.back()->start + stack.back()->duration < time){
+			const double end = stack.back()->start + stack.back()->duration;
+			emit(currentStart, end, stack.back()->velocity);
+			stack.pop_back();
+			// Skip presses entirely covered by the one that just ended.
+			while(!stack.empty() && stack.back()->start + stack.back()->duration <= end){
+				stack.pop_back();
+			}
+			// The previous press resumes right after.
+			currentStart = std::nextafter(end, std::numeric_limits<double>::max());
+		}
+	};
+
+	for(const MIDIPedal* press : presses){
+		finishUntil(press->start);
+		if(!stack.empty() && currentStart < press->start){
+			// Lookups pick the most recent segment, so ending at the new press start is fine.
+			emit(currentStart, press->start, stack.back()->velocity);
+		}
+		stack.push_back(press);
+		currentStart = press->start;
+	}
+	finishUntil(std::numeric_limits<double>::infinity());
+}
+
+void PedalTimeline::append(const std::vector<MIDIPedal> & pedals, size_t first, PedalType type, float scale){
+	for(size_t pid = first; pid < pedals.size(); ++pid){
+		const MIDIPedal & pedal = pedals[pid];
+		if(pedal.type != type){
+			continue;
+		}
+		// Lookups pick the most recent segment, so ending at the new press start is fine.
+		if(!_segments.empty()){
+			_segments.back().end = (std::min)(_segments.back().end, pedal.start);
+		}
+		_segments.push_back({pedal.start, pedal.start + pedal.duration, pedal.velocity * scale});
+	}
+}
+
+long PedalTimeline::segmentIndex(double time) const {
+	const auto next = std::upper_bound(_segments.begin(), _segments.end(), time, [](double t, const Segment & segment){
+		return t < segment.start;
+	});
+	return long(next - _segments.begin()) - 1;
+}
+
+float PedalTimeline::valueAt(double time) const {
+	const long index = segmentIndex(time);
+	if(index < 0 || time > _segments[index].end){
+		return 0.0f;
+	}
+	return _segments[index].velocity;
+}
+
+float PedalTimeline::maxValue(double startTime, double endTime) const {
+	float value = 0.0f;
+	// Start from the segment containing the range start, if any.
+	long index = (std::max)(segmentIndex(startTime), 0l);
+	for(; index < long(_segments.size()) && _segments[index].start <= endTime; ++index){
+		if(_segments[index].end >= startTime){
+			value = (std::max)(value, _segments[index].velocity);
+		}
+	}
+	return value;
+}
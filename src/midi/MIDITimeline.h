@@ -0,0 +1,90 @@
+#ifndef MIDI_TIMELINE_H
+#define MIDI_TIMELINE_H
+
+#include "MIDIBase.h"
+
+// Playback position in a NoteTimeline, with the notes currently active on each key.
+struct NoteCursor {
+	std::array<std::vector<uint32_t>, 128> actives; ///< Indices of active notes, per key.
+	std::vector<uint32_t> started; ///< Notes started during the last forward move.
+	double time = 0.0;
+	size_t startPos = 0;
+	size_t endPos = 0;
+	bool valid = false;
+};
+
+// Notes sorted by start and end times, with periodic snapshots of the active notes.
+// Cursors can then be moved incrementally during playback, or restored from a snapshot when seeking.
+class NoteTimeline {
+
+public:
+
+	void build(const NoteStore & notes);
+
+	/// Register notes appended after first, starting after all existing notes. Until the next build,
+	/// no snapshots are available and moving backward restarts from the beginning.
+	void append(const NoteStore & notes, size_t first);
+
+	void clear();
+
+	/// Move the cursor to the given time. When moving forward, notes started since the previous position are listed in the cursor.
+	void moveTo(NoteCursor & cursor, const NoteStore & notes, double time) const;
+
+private:
+
+	struct Checkpoint {
+		double time;
+		size_t startPos;
+		size_t endPos;
+		size_t firstActive;
+		size_t activeCount;
+	};
+
+	void seek(NoteCursor & cursor, const NoteStore & notes, double time) const;
+
+	void advance(NoteCursor & cursor, const NoteStore & notes, double time, bool recordStarts) const;
+
+	void advanceAppended(NoteCursor & cursor, const NoteStore & notes, double time, bool recordStarts) const;
+
+	std::vector<uint32_t> _starts; ///< Note indices sorted by start time.
+	std::vector<uint32_t> _ends; ///< Note indices sorted by end time.
+	std::vector<Checkpoint> _checkpoints;
+	std::vector<uint32_t> _checkpointsActives; ///< Notes active at each checkpoint, stored contiguously.
+	bool _appended = false; ///< Notes have been appended since the last build.
+
+};
+
+// Pedal segments of a given type, flattened into sorted non-overlapping segments.
+// When presses overlap, the most recent one takes precedence.
+class PedalTimeline {
+
+public:
+
+	void build(const std::vector<MIDIPedal> & pedals, PedalType type);
+
+	/// Add presses appended after first, starting after all existing ones, with velocities scaled.
+	/// A new press interrupts the previous one for good, until the next build.
+	void append(const std::vector<MIDIPedal> & pedals, size_t first, PedalType type, float scale);
+
+	/// Pedal value at the given time, or 0 if released.
+	float valueAt(double time) const;
+
+	/// Maximum pedal value over the time range.
+	float maxValue(double startTime, double endTime) const;
+
+private:
+
+	struct Segment {
+		double start;
+		double end; ///< Included.
+		float velocity;
+	};
+
+	/// Index of the last segment starting at or before the time, or -1.
+	long segmentIndex(double time) const;
+
+	std::vector<Segment> _segments;
+
+};
+
+#endif // MIDI_TIMELINE_H
@@ -1,35 +1,21 @@
 #include "MIDITrack.h"
 
-#include <tuple>
 #include <cmath>
 #include <algorithm>
 #include "../rendering/SetOptions.h"
-#include "../rendering/State.h"
+#include "../rendering/FilterOptions.h"
 
-// We will have to keep track of active notes per-channel.
-struct NoteKey {
-	short index;
-	short channel;
-};
+// Below this number of tracks, merging in parallel is not worth it.
+#define MERGE_PARALLEL_TRACKS 64
+// Number of notes whose sets are updated by each task.
+#define SETS_UPDATE_RANGE 65536
 
-bool operator==(const NoteKey& a, const NoteKey& b){
-	return (a.index == b.index) && (a.channel == b.channel);
-}
-
-namespace std {
-	template<> struct hash<NoteKey> {
-		std::size_t operator()(const NoteKey& n) const noexcept {
-			return ((n.index & 0xFFFF) << 16) | ( n.channel & 0xFFFF);
-		}
-	};
-}
-
-size_t MIDITrack::readTrack(const std::vector<char>& buffer, size_t pos){
+size_t MIDITrack::readTrack(const MIDISpan& buffer, size_t pos, bool selective){
 	const size_t backupPos = pos;
 	
 	//Check header
-	if( !(buffer[pos] == 'M' && buffer[pos+1] == 'T' && buffer[pos+2] == 'r' && buffer[pos+3] == 'k')){
-		std::cerr << "[ERROR]: Missing track." << std::endl;
+	if( !(read8(buffer, pos) == 'M' && read8(buffer, pos+1) == 'T' && read8(buffer, pos+2) == 'r' && read8(buffer, pos+3) == 'k')){
+		_error = "Missing track.";
 		return 3;
 	}
 	pos += 4;
@@ -37,159 +23,117 @@ size_t MIDITrack::readTrack(const std::vector<char>& buffer, size_t pos){
 	pos += 4;
 	
 	if(length == 0){
-		std::cerr << "[ERROR]: Empty track." << std::endl;
+		_error = "Empty track.";
 		return 3;
 	}
+	// Don't read past the end of the file if the track is truncated.
+	const size_t endPos = (std::min)(backupPos + 8 + length, buffer.size);
 
-	while(pos < backupPos + 8 + length){
+	// Skipped events delta is carried over to the next kept event.
+	size_t delta = 0;
+	MIDIEvent event;
+	while(pos < endPos){
 		
-		size_t delta = readVarLen(buffer,pos);
-		uint8_t eventMetaType = read8(buffer, pos);
-		
-		if(eventMetaType == 0xFF){
-			_events.push_back(MIDIEvent::readMetaEvent(buffer,pos, delta));
-		} else if (eventMetaType >= 0xF0 && eventMetaType <= 0xF7){
-			_events.push_back(MIDIEvent::readSysexEvent(buffer, pos, delta));
-		}  else {
-			_events.push_back(MIDIEvent::readMIDIEvent(buffer, pos, delta, _previousEventFirstByte));
+		delta += readVarLen(buffer,pos);
+		if(MIDIEvent::readEvent(buffer, pos, delta, _previousEventFirstByte, _payloads, selective, event)){
+			_events.push_back(event);
+			delta = 0;
 		}
 	}
 
 	// Scan events for track info.
 	// Could do it while creating events, but let's separate tasks, shall we?
-	bool minorKey = false;
 	short keyShift = 0;
 
 	for(auto& event : _events){
 		if(event.category == EventCategory::META){
 			if(event.type == sequenceName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
-				}
-				_name = tempName;
+				_name = payloadString(event);
 			} else if(event.type == instrumentName){
-				std::string tempName = "";
-				for(size_t i = 0; i < event.data.size(); ++i){
-					tempName += char(event.data[i]);
-				}
-				_instrument = tempName;
-			} else if (event.type == keySignature){
+				_instrument = payloadString(event);
+			} else if (event.type == keySignature && event.payload.length >= 2){
 				// Should be in -7,7
-				keyShift = event.data[0];
-				minorKey = (event.data[1] > 0);
+				keyShift = _payloads[event.payload.offset];
+				_minorKey = (_payloads[event.payload.offset + 1] > 0);
 			}
 		}
 	}
-	
-	std::cout << "[INFO]: Track " << _name << " (length: " << length << ", instrument: " << _instrument <<", " << (minorKey ? "minor": "major") << ")." << std::endl;
+	_length = length;
 	
 	return backupPos + 8 + length;
 }
 
+size_t MIDITrack::skipTrack(const MIDISpan& buffer, size_t pos){
+	// Same checks as readTrack, without decoding events.
+	if( !(read8(buffer, pos) == 'M' && read8(buffer, pos+1) == 'T' && read8(buffer, pos+2) == 'r' && read8(buffer, pos+3) == 'k')){
+		return 3;
+	}
+	const uint32_t length = read32(buffer, pos + 4);
+	if(length == 0){
+		return 3;
+	}
+	return pos + 8 + length;
+}
+
+void MIDITrack::printInfos() const {
+	if(_error != nullptr){
+		std::cerr << "[ERROR]: " << _error << std::endl;
+		return;
+	}
+	std::cout << "[INFO]: Track " << _name << " (length: " << _length << ", instrument: " << _instrument <<", " << (_minorKey ? "minor": "major") << ")." << std::endl;
+}
+
 double MIDITrack::extractTempos(std::vector<MIDITempo> & tempos) const {
 	size_t timeInUnits = 0;
 	double signature = 4.0/4.0;
 	for(auto& event : _events){
 		timeInUnits += (event.delta);
-		if(event.category == EventCategory::META && event.type == setTempo){
-			const unsigned int tempo = ((event.data[0] & 0xFF) << 16) | ((event.data[1] & 0xFF) << 8) | (event.data[2] & 0xFF);
+		if(event.category != EventCategory::META){
+			continue;
+		}
+		const uint8_t* data = _payloads.data() + event.payload.offset;
+		if(event.type == setTempo && event.payload.length >= 3){
+			const unsigned int tempo = (data[0] << 16) | (data[1] << 8) | data[2];
 			tempos.emplace_back(timeInUnits, tempo);
 
-		} else if(event.category == EventCategory::META && event.type == timeSignature){
-			signature = double(event.data[0]) / double(std::pow(2,event.data[1]));
+		} else if(event.type == timeSignature && event.payload.length >= 2){
+			signature = double(data[0]) / double(std::pow(2,data[1]));
 
 		}
 	}
 	return signature;
 }
 
-void MIDITrack::extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId){
+void MIDITrack::extractNotes(const std::shared_ptr<const TempoMap> & tempos, unsigned int trackId, NotePairing pairing){
 	// Scan events, focusing on the note ON/OFF events.
-	// Keep track of active notes for each channel.
-	std::unordered_map<NoteKey, std::tuple<size_t, short, short>> currentNotes;
-	std::unordered_map<PedalType, std::tuple<size_t, short>> currentPedals;
-
+	EventPairing currentEvents(pairing);
+	// Events are in increasing time order.
+	TempoMap::Cursor tempoCursor = tempos->cursor();
+	_notes.setTempoMap(tempos);
 	size_t timeInUnits = 0;
 
 	for(auto& event : _events){
 		timeInUnits += (event.delta);
-		if(event.category != EventCategory::MIDI){
+		if(!EventPairing::isRelevant(event)){
 			continue;
 		}
-
-		// Handle notes.
-		if(event.type == noteOn || event.type == noteOff){
-			// Ensure the ID is in 0-127.
-			const short noteInd = clamp<short>(event.data[1], 0, 127);
-			const short velocity = clamp<short>(event.data[2], 0, 127);
-			const short channel = event.data[0];
-
-			const NoteKey newNote = {noteInd, channel};
-			if(currentNotes.count(newNote) > 0){
-				// The current note is already present.
-				const auto & noteTuple = currentNotes[newNote];
-				// Finish it.
-				const size_t start = std::get<0>(noteTuple);
-				const size_t end = timeInUnits;
-				// Create the final note with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-
-				const short velocity = std::get<1>(noteTuple);
-				const short channel = std::get<2>(noteTuple);
-				_notes.emplace_back(noteInd, times.first, times.second - times.first, velocity, channel, trackId);
-
-				// Remove note.
-				currentNotes.erase(newNote);
-			}
-
-			// Check if we have to start a new note.
-			const bool shouldNew = event.type == noteOn && velocity > 0;
-			if(shouldNew){
-				currentNotes[newNote] = std::make_tuple(timeInUnits, velocity, channel);
-			}
-		} else if(event.type == controllerChange){
-			const int rawType = clamp<int>(event.data[1], 0, 127);
-			// Handle only pedal changes.
-			if(rawType != 64 && rawType != 66 && rawType != 67 && rawType != 11){
-				continue;
-			}
-			const PedalType type = PedalType(rawType);
-
-			if(currentPedals.count(type) > 0){
-				// Stop the current event, store it.
-				const auto & pedalTuple = currentPedals[type];
-				const size_t start = std::get<0>(pedalTuple);
-				const size_t end = timeInUnits;
-				// Create the final pedal with timing.
-				// Look for the start and end timestamps using the tempos and their timestamps.
-
-				const auto times = computeNoteTimings(tempos, start, end, unitsPerQuarterNote);
-				const double duration = times.second - times.first;
-				if(duration > 0.0){
-					const float velocity = float(std::get<1>(pedalTuple));
-					_pedals.emplace_back(type, times.first, duration, velocity);
-				}
-
-				// Remove press.
-				currentPedals.erase(type);
-			}
-			// Check if we have to start a new press.
-			const short val = clamp<short>(event.data[2], 0, 127);
-			const bool shouldNew = val > 0;
-			if(shouldNew){
-				currentPedals[type] = std::make_tuple(timeInUnits, val);
-			}
-
-		}
+		currentEvents.process(event, uint32_t(timeInUnits), tempoCursor, trackId, _notes, _pedals);
 	}
+	// Notes and pedals are completed in end order, sort them by start for merging.
+	_notes.reorder(_notes.sortedByStart());
+	std::stable_sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b){
+		return a.start < b.start;
+	});
 }
 
-void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter ) const {
+void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter, size_t first ) const {
 	notes.clear();
-	notes.reserve( _notes.size() );
-	for(auto& note : _notes){
+	if(first >= _notes.size()){
+		return;
+	}
+	notes.reserve( _notes.size() - first );
+	for(size_t nid = first; nid < _notes.size(); ++nid){
+		const MIDINote note = _notes.note(nid);
 		const bool isMin = noteIsMinor[note.note % 12];
 		const short shiftId = (note.note/12) * 7 + noteShift[note.note % 12];
 		if(type == NoteType::ALL || (type == NoteType::MINOR && isMin) || (type == NoteType::MAJOR && !isMin)){
@@ -197,29 +141,56 @@ void MIDITrack::getNotes(std::vector<MIDINote> & notes, NoteType type, const Fil
 				continue;
 			notes.push_back(note);
 			notes.back().note = shiftId;
+			notes.back().set = noteSet(nid);
 		}
 	}
 
 }
 
-void MIDITrack::getNotesActive(ActiveNotesArray & actives, double time, const FilterOptions& filter ) const {
-	// Reset all notes.
+void MIDITrack::buildTimeline(){
+	_timeline.build(_notes);
+	_pedalTimelines[0].build(_pedals, PedalType::DAMPER);
+	_pedalTimelines[1].build(_pedals, PedalType::SOSTENUTO);
+	_pedalTimelines[2].build(_pedals, PedalType::SOFT);
+	_pedalTimelines[3].build(_pedals, PedalType::EXPRESSION);
+}
+
+void MIDITrack::getNotesActive(ActiveNotesArray & actives, ActiveNotesArray & started, NoteCursor & cursor, double time, const FilterOptions& filter ) const {
+	_timeline.moveTo(cursor, _notes, time);
+
 	for(int i = 0; i < int(actives.size()); ++i){
-		 actives[i].enabled = false;
-	}
-	const size_t count = _notes.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& note = _notes[i];
-		if(note.start <= time && note.start+note.duration >= time){
-			if( !filter.accepts( note.track, note.channel ) )
-				continue;
-			auto & actNote = actives[note.note];
-			actNote.enabled = true;
-			actNote.duration = float(note.duration);
-			actNote.start = float(note.start);
-			actNote.set = note.set;
-			actNote.velocity = float(note.velocity);
+		auto & actNote = actives[i];
+		actNote.enabled = false;
+		// If multiple notes are active on the same key, keep the last one in the file.
+		int selected = -1;
+		for(const uint32_t id : cursor.actives[i]){
+			if(int(id) > selected && filter.accepts( _notes.track(id), _notes.channel(id) )){
+				selected = int(id);
+			}
 		}
+		if(selected < 0){
+			continue;
+		}
+		actNote.enabled = true;
+		actNote.duration = float(_notes.duration(selected));
+		actNote.start = float(_notes.start(selected));
+		actNote.set = noteSet(selected);
+		actNote.velocity = float(_notes.velocity(selected));
+	}
+
+	// Notes started since the previous call, even if they are already finished.
+	for(auto & startNote : started){
+		startNote.enabled = false;
+	}
+	for(const uint32_t id : cursor.started){
+		if( !filter.accepts( _notes.track(id), _notes.channel(id) ) )
+			continue;
+		auto & startNote = started[_notes.key(id)];
+		startNote.enabled = true;
+		startNote.duration = float(_notes.duration(id));
+		startNote.start = float(_notes.start(id));
+		startNote.set = noteSet(id);
+		startNote.velocity = float(_notes.velocity(id));
 	}
 }
 
@@ -241,37 +212,31 @@ void MIDITrack::normalizePedalVelocity() {
 }
 
 void MIDITrack::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time) const {
-	damper = sostenuto = soft = expression = 0.0f;
-	
-	const size_t count = _pedals.size();
-	for(size_t i = 0; i < count; ++i){
-		auto& pedal = _pedals[i];
-		if(pedal.start <= time && pedal.start+pedal.duration >= time){
-			if(pedal.type == PedalType::DAMPER){
-				damper = pedal.velocity;
-			} else if(pedal.type == PedalType::SOSTENUTO){
-				sostenuto = pedal.velocity;
-			} else if(pedal.type == PedalType::SOFT){
-				soft = pedal.velocity;
-			} else if(pedal.type == PedalType::EXPRESSION){
-				expression = pedal.velocity;
-			}
-			// Early exit (rare).
-			if(damper != 0.0f && sostenuto != 0.0f && soft != 0.0f && expression != 0.0f){
-				break;
-			}
-		}
-	}
+	damper = _pedalTimelines[0].valueAt(time);
+	sostenuto = _pedalTimelines[1].valueAt(time);
+	soft = _pedalTimelines[2].valueAt(time);
+	expression = _pedalTimelines[3].valueAt(time);
+}
+
+void MIDITrack::getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double startTime, double endTime) const {
+	damper = _pedalTimelines[0].maxValue(startTime, endTime);
+	sostenuto = _pedalTimelines[1].maxValue(startTime, endTime);
+	soft = _pedalTimelines[2].maxValue(startTime, endTime);
+	expression = _pedalTimelines[3].maxValue(startTime, endTime);
 }
 
 void MIDITrack::print() const {
-	std::cout << "[INFO]: * Events (" << _events.size() << "): " << std::endl;
+	if(_events.empty()){
+		std::cout << "[INFO]: * Events released after loading." << std::endl;
+	} else {
+		std::cout << "[INFO]: * Events (" << _events.size() << "), payloads (" << _payloads.size() << " bytes): " << std::endl;
+	}
 	for(auto& event : _events){
 		event.print();
 	}
 	std::cout << "[INFO]: * Notes (" << _notes.size() << "): " << std::endl;
-	for(auto& note : _notes){
-		note.print();
+	for(size_t nid = 0; nid < _notes.size(); ++nid){
+		_notes.note(nid).print();
 	}
 
 	std::cout << "[INFO]: * Pedals (" << _pedals.size() << "): " << std::endl;
@@ -280,47 +245,106 @@ void MIDITrack::print() const {
 	}
 }
 
-void MIDITrack::merge(MIDITrack & other){
-	for(auto& note : other._notes){
-		_notes.push_back(note);
+void MIDITrack::releaseEvents(){
+	// Swap with empty containers to free the memory.
+	std::vector<MIDIEvent>().swap(_events);
+	std::vector<uint8_t>().swap(_payloads);
+}
+
+std::string MIDITrack::payloadString(const MIDIEvent & event) const {
+	const char* start = reinterpret_cast<const char*>(_payloads.data()) + event.payload.offset;
+	return std::string(start, event.payload.length);
+}
+
+void MIDITrack::merge(const std::vector<MIDITrack> & tracks, unsigned int threadCount){
+	if(tracks.size() <= 1){
+		return;
 	}
-	std::sort(_notes.begin(), _notes.end(), [](const MIDINote & a, const MIDINote & b) { return(a.start < b.start); } );
+	// With many tracks, first merge groups of consecutive tracks in parallel, then merge the groups.
+	std::vector<MIDITrack> groups;
+	if(threadCount > 1 && tracks.size() >= MERGE_PARALLEL_TRACKS){
+		const size_t groupCount = (std::min)(size_t(threadCount), tracks.size() / (MERGE_PARALLEL_TRACKS / 2));
+		groups.resize(groupCount);
+		parallelFor(groupCount, threadCount, [&tracks, &groups, groupCount](size_t gid){
+			const size_t first = tracks.size() * gid / groupCount;
+			const size_t last = tracks.size() * (gid + 1) / groupCount;
+			groups[gid].mergeRange(tracks, first, last);
+		});
+	}
+	const std::vector<MIDITrack> & sources = groups.empty() ? tracks : groups;
+	mergeRange(sources, 0, sources.size());
+}
 
-	for(auto& pedal : other._pedals){
-		_pedals.push_back(pedal);
+void MIDITrack::mergeRange(const std::vector<MIDITrack> & tracks, size_t first, size_t last){
+	NoteStore notes;
+	notes.setTempoMap(tracks[first]._notes.tempoMap());
+	std::vector<const NoteStore*> stores;
+	std::vector<size_t> pedalCounts;
+	size_t pedalTotal = 0;
+	for(size_t tid = first; tid < last; ++tid){
+		stores.push_back(&tracks[tid]._notes);
+		pedalCounts.push_back(tracks[tid]._pedals.size());
+		pedalTotal += pedalCounts.back();
 	}
-	std::sort(_pedals.begin(), _pedals.end(), [](const MIDIPedal & a, const MIDIPedal & b) { return(a.start < b.start); } );
+	notes.merge(stores);
+
+	std::vector<MIDIPedal> pedals;
+	pedals.reserve(pedalTotal);
+	mergeSorted(pedalCounts, [&tracks, first](size_t sid, size_t pid){
+		return tracks[first + sid]._pedals[pid].start;
+	}, [&tracks, &pedals, first](size_t sid, size_t pid){
+		pedals.push_back(tracks[first + sid]._pedals[pid]);
+	});
+
+	std::swap(_notes, notes);
+	std::swap(_pedals, pedals);
 }
 
-std::pair<double, double> MIDITrack::computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const {
-	double startTime;
-	double endTime;
+void MIDITrack::append(const NoteStore & notes, const std::vector<MIDIPedal> & pedals){
+	const size_t firstNote = _notes.size();
+	_notes.append(notes);
+	// The new tempo map also covers previous notes.
+	_notes.setTempoMap(notes.tempoMap());
+	_timeline.append(_notes, firstNote);
+
+	// Pedals are normalized once all of them are known, use the maximum possible velocity until then.
+	const size_t firstPedal = _pedals.size();
+	_pedals.insert(_pedals.end(), pedals.begin(), pedals.end());
+	const float scale = 1.0f / 127.0f;
+	_pedalTimelines[0].append(_pedals, firstPedal, PedalType::DAMPER, scale);
+	_pedalTimelines[1].append(_pedals, firstPedal, PedalType::SOSTENUTO, scale);
+	_pedalTimelines[2].append(_pedals, firstPedal, PedalType::SOFT, scale);
+	_pedalTimelines[3].append(_pedals, firstPedal, PedalType::EXPRESSION, scale);
+}
 
-	size_t tid = 0;
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > start)){
-			// The note started before tid+1, we should use the previous one.
-			startTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, start - tempos[tid].start, upqn);
-			break;
-		}
+void MIDITrack::assign(NoteStore & notes, std::vector<MIDIPedal> & pedals){
+	std::swap(_notes, notes);
+	std::swap(_pedals, pedals);
+}
+
+void MIDITrack::updateSets(const SetOptions & options, size_t first){
+	_setOptions = options;
+	if(options.mode != SetMode::LIST || first >= _notes.size()){
+		return;
 	}
-	// Start from the same one again.
-	for(; tid < tempos.size(); ++tid){
-		if((tid == tempos.size() - 1) || (tempos[tid+1].start > end)){
-			// The note ended before tid+1, we should use the previous one.
-			endTime = tempos[tid].timestamp + computeUnitsDuration(tempos[tid].tempo, end - tempos[tid].start, upqn);
-			break;
+	// Notes are independent, process ranges of them in parallel.
+	const size_t rangeCount = (_notes.size() - first + SETS_UPDATE_RANGE - 1) / SETS_UPDATE_RANGE;
+	parallelFor(rangeCount, computeThreadCount(0, rangeCount), [this, first](size_t rid){
+		const size_t rangeStart = first + rid * SETS_UPDATE_RANGE;
+		const size_t rangeEnd = (std::min)(rangeStart + SETS_UPDATE_RANGE, _notes.size());
+		NoteStore::Cursor noteTimes(_notes);
+		double start, duration;
+		for(size_t nid = rangeStart; nid < rangeEnd; ++nid){
+			noteTimes.times(nid, start, duration);
+			_notes.setSet(nid, _setOptions.apply(_notes.key(nid), _notes.channel(nid), _notes.track(nid), start));
 		}
-	}
-
-	startTime /= 1000000.0;
-	endTime /= 1000000.0;
-
-	return std::make_pair(startTime, endTime);
+	});
 }
 
-void MIDITrack::updateSets(const SetOptions & options){
-	for(auto & note : _notes){
-		note.set = options.apply(note.note, note.channel, note.track, note.start);
+int MIDITrack::noteSet(size_t id) const {
+	// List sets depend on the note start and are computed in advance.
+	if(_setOptions.mode == SetMode::LIST){
+		return _notes.set(id);
 	}
+	return _setOptions.apply(_notes.key(id), _notes.channel(id), _notes.track(id), 0.0);
 }
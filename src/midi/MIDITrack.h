@@ -2,6 +2,8 @@
 #define MIDI_TRACK_H
 
 #include "MIDIBase.h"
+#include "MIDITimeline.h"
+#include "../rendering/SetOptions.h"
 
 typedef std::array<ActiveNoteInfos, 128> ActiveNotesArray;
 
@@ -10,36 +12,81 @@ struct FilterOptions;
 class MIDITrack {
 public:
 	
-	size_t readTrack(const std::vector<char>& buffer, size_t pos);
+	/// Decode all events of the track chunk at pos, or only those used for display in selective mode.
+	/// Can run on a worker thread, errors are kept and reported by printInfos.
+	size_t readTrack(const MIDISpan& buffer, size_t pos, bool selective = false);
+
+	/// Position of the chunk following the one at pos, as returned by readTrack.
+	static size_t skipTrack(const MIDISpan& buffer, size_t pos);
+
+	/// Report track infos, or the error met by readTrack.
+	void printInfos() const;
 	
 	double extractTempos(std::vector<MIDITempo> & tempos) const;
 
-	void extractNotes(const std::vector<MIDITempo> & tempos, uint16_t unitsPerQuarterNote, unsigned int trackId);
+	void extractNotes(const std::shared_ptr<const TempoMap> & tempos, unsigned int trackId, NotePairing pairing);
 
 	void print() const;
 
-	void getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter ) const;
+	/// List notes of the given type, starting from the note at index first.
+	void getNotes(std::vector<MIDINote> & notes, NoteType type, const FilterOptions& filter, size_t first = 0 ) const;
+
+	/// Move the cursor to the given time and list active notes, along with notes started since the cursor previous position.
+	void getNotesActive(ActiveNotesArray & actives, ActiveNotesArray & started, NoteCursor & cursor, double time, const FilterOptions& filter ) const;
 
-	void getNotesActive(ActiveNotesArray & actives, double time, const FilterOptions& filter ) const;
+	/// Prepare the timelines used for active notes and pedals queries, once all notes and pedals are known.
+	void buildTimeline();
 
 	void normalizePedalVelocity();
 
 	void getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double time) const;
+
+	/// Maximum value of each pedal over a time range.
+	void getPedalsActive(float & damper, float &sostenuto, float &soft, float &expression, double startTime, double endTime) const;
 	
-	void merge(MIDITrack & other);
+	/// Replace notes and pedals by those of all the given tracks (including this one), in a single pass.
+	/// Tracks should have been extracted beforehand, simultaneous events are ordered by track.
+	void merge(const std::vector<MIDITrack> & tracks, unsigned int threadCount);
+
+	/// Append notes and pedals sorted by start, starting after all existing ones.
+	/// Timelines are extended right away, buildTimeline should be called once all notes have been received.
+	void append(const NoteStore & notes, const std::vector<MIDIPedal> & pedals);
+
+	/// Free raw events and payloads, once notes and tempos have been extracted.
+	void releaseEvents();
 
-	void updateSets(const SetOptions & options);
+	/// Only list sets are stored per note, other modes are resolved when querying notes.
+	void updateSets(const SetOptions & options, size_t first = 0);
+
+	const NoteStore & notes() const { return _notes; }
+
+	const std::vector<MIDIPedal> & pedals() const { return _pedals; }
+
+	/// Replace notes and pedals by already extracted ones, buildTimeline should be called afterwards.
+	void assign(NoteStore & notes, std::vector<MIDIPedal> & pedals);
 
 private:
 
-	std::pair<double, double> computeNoteTimings(const std::vector<MIDITempo> & tempos, size_t start,size_t end, uint16_t upqn) const;
+	std::string payloadString(const MIDIEvent & event) const;
+
+	int noteSet(size_t id) const;
+
+	/// Replace notes and pedals by those of tracks in [first, last).
+	void mergeRange(const std::vector<MIDITrack> & tracks, size_t first, size_t last);
 
 	std::vector<MIDIEvent> _events;
-	std::vector<MIDINote> _notes;
+	std::vector<uint8_t> _payloads; ///< Meta and sysex data for all events.
+	NoteStore _notes;
 	std::vector<MIDIPedal> _pedals;
+	SetOptions _setOptions;
+	NoteTimeline _timeline;
+	std::array<PedalTimeline, 4> _pedalTimelines; ///< Damper, sostenuto, soft, expression.
 
 	std::string _name;
 	std::string _instrument;
+	uint32_t _length = 0;
+	const char* _error = nullptr; ///< Set if the track chunk is invalid.
+	bool _minorKey = false;
 	uint8_t _previousEventFirstByte = 0x0;
 
 };
@@ -7,6 +7,8 @@
 #include <string>
 #include <iostream>
 #include <array>
+#include <functional>
+#include <queue>
 
 struct SetOptions;
 
@@ -45,7 +47,7 @@ enum MIDIEventType : uint8_t {
 	
 };
 
-enum class EventCategory {
+enum class EventCategory : uint8_t {
 	MIDI, SYSTEM, META
 };
 
@@ -53,6 +55,13 @@ enum class NoteType{
 	MAJOR, MINOR, ALL
 };
 
+// How note on/off events on the same key and channel are paired.
+enum class NotePairing : int {
+	RETRIGGER = 0, ///< A new note on finishes the current note.
+	FIFO = 1, ///< Overlapping notes, a note off finishes the oldest one.
+	LIFO = 2 ///< Overlapping notes, a note off finishes the most recent one.
+};
+
 enum PedalType : uint8_t {
 	EXPRESSION = 11, DAMPER = 64, SOSTENUTO = 66, SOFT = 67
 };
@@ -73,31 +82,45 @@ extern const char* midiKeysStrings[];
 
 // Read data.
 
-inline uint32_t read32(const std::vector<char>& buffer, size_t position){
-	return (buffer[position] & 0xFF) << 24 | (buffer[position+1] & 0xFF) << 16 | (buffer[position+2] & 0xFF) << 8 | (buffer[position+3] & 0xFF);
+// Read-only view on a range of bytes (memory-mapped file or loaded buffer).
+struct MIDISpan {
+
+	MIDISpan() = default;
+
+	MIDISpan(const uint8_t* aData, size_t aSize) : data(aData), size(aSize) {}
+
+	uint8_t operator[](size_t position) const { return data[position]; }
+
+	const uint8_t* data = nullptr;
+	size_t size = 0;
+};
+
+inline uint8_t read8(const MIDISpan& buffer, size_t position){
+	// Reading past the end (truncated files) returns 0, as an end of track would.
+	return position < buffer.size ? buffer[position] : 0;
 }
 
-inline uint8_t getBit(uint32_t number, short bit){
+inline uint8_t getBit(uint8_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint16_t read16(const std::vector<char>& buffer, size_t position){
-	return (buffer[position] & 0xFF) << 8 | (buffer[position+1] & 0xFF);
+inline uint32_t read32(const MIDISpan& buffer, size_t position){
+	return uint32_t(read8(buffer, position)) << 24 | uint32_t(read8(buffer, position+1)) << 16 | uint32_t(read8(buffer, position+2)) << 8 | uint32_t(read8(buffer, position+3));
 }
 
-inline uint8_t getBit(uint16_t number, short bit){
+inline uint8_t getBit(uint32_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline uint8_t read8(const std::vector<char>& buffer, size_t position){
-	return buffer[position] & 0xFF;
+inline uint16_t read16(const MIDISpan& buffer, size_t position){
+	return uint16_t(read8(buffer, position) << 8 | read8(buffer, position+1));
 }
 
-inline uint8_t getBit(uint8_t number, short bit){
+inline uint8_t getBit(uint16_t number, short bit){
 	return (number & (0x1 << bit)) >> bit;
 }
 
-inline size_t readVarLen(const std::vector<char>& buffer, size_t & position){
+inline size_t readVarLen(const MIDISpan& buffer, size_t & position){
 	size_t lastIndex = 0;
 	size_t accum = 0;
 	uint8_t currentByte = read8(buffer, position + lastIndex);
@@ -128,5 +151,37 @@ T clamp(T x, T a, T b) {
 	return (std::min)((std::max)(x, a), b);
 }
 
+// Parallel processing.
+
+/// Number of workers to use for a requested count (0 means all available cores), bounded by the number of tasks.
+unsigned int computeThreadCount(unsigned int requested, size_t taskCount);
+
+/// Run task(i) for i in [0, count) on threadCount threads, dynamically balanced. Returns once all tasks are done.
+/// If tasks throw, remaining tasks are skipped and the first exception is rethrown on the calling thread.
+void parallelFor(size_t count, unsigned int threadCount, const std::function<void(size_t)> & task);
+
+/// Visit elements of several sorted sequences in a single k-way pass, calling emit(sequence, index) in increasing key order.
+/// key(sequence, index) returns the sort key of an element. Equal keys are visited by sequence, then by index.
+template<typename Key, typename Emit>
+void mergeSorted(const std::vector<size_t> & sizes, const Key & key, const Emit & emit){
+	typedef std::pair<decltype(key(size_t(0), size_t(0))), size_t> Head;
+	std::priority_queue<Head, std::vector<Head>, std::greater<Head>> heads;
+	std::vector<size_t> positions(sizes.size(), 0);
+	for(size_t sid = 0; sid < sizes.size(); ++sid){
+		if(sizes[sid] != 0){
+			heads.emplace(key(sid, 0), sid);
+		}
+	}
+	while(!heads.empty()){
+		const size_t sid = heads.top().second;
+		heads.pop();
+		size_t & position = positions[sid];
+		emit(sid, position);
+		++position;
+		if(position < sizes[sid]){
+			heads.emplace(key(sid, position), sid);
+		}
+	}
+}
 
 #endif // MIDI_UTILS_H
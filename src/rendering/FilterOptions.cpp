@@ -0,0 +1,98 @@
+#include "FilterOptions.h"
+
+#include <algorithm>
+#include <iostream>
+#include <sstream>
+
+FilterOptions::FilterOptions(){
+	channels.fill( true );
+}
+
+void FilterOptions::fillChannelsFromTokens( const std::vector<std::string>& list, bool enabled ){
+	for( const std::string& token : list ){
+		if( token.empty() ){
+			continue;
+		}
+		int index = std::stoi( token );
+		if( index < 0 || index >= channels.size() ){
+			continue;
+		}
+		channels[ index ] = enabled;
+	}
+}
+
+void FilterOptions::fillTracksFromTokens( const std::vector<std::string>& list, bool enabled ){
+	for( const std::string& token : list ){
+		if( token.empty() ){
+			continue;
+		}
+		int index = std::stoi( token );
+		if( index >= MAX_TRACK_COUNT ){
+			std::cerr << "[WARNING]: Track " << index << " is past the " << MAX_TRACK_COUNT << " tracks that can be hidden, ignoring it." << std::endl;
+			continue;
+		}
+		if( index < 0 ){
+			continue;
+		}
+		const size_t newMaxTrack = ( std::max )( tracks.size(), size_t( index ) + 1 );
+		// All new tracks are assumed visible.
+		tracks.resize( newMaxTrack, true );
+		tracks[ index ] = enabled;
+	}
+}
+
+std::string FilterOptions::toHiddenChannelsString(){
+	std::vector<unsigned int> hiddenChannels;
+	hiddenChannels.reserve( channels.size() );
+	for( unsigned int i = 0; i < channels.size(); ++i )
+		if( !channels[ i ] )
+			hiddenChannels.push_back( i );
+
+	std::stringstream str;
+	for( unsigned int chan : hiddenChannels ){
+		str << chan << " ";
+	}
+	return str.str();
+}
+
+std::string FilterOptions::toHiddenTracksString(){
+	std::vector<unsigned int> hiddenTracks;
+	hiddenTracks.reserve( tracks.size() );
+	for( unsigned int i = 0; i < tracks.size(); ++i )
+		if( !tracks[ i ] )
+			hiddenTracks.push_back( i );
+
+	std::stringstream str;
+	for( unsigned int track : hiddenTracks ){
+		str << track << " ";
+	}
+	return str.str();
+}
+
+bool FilterOptions::accepts( int track, int channel ) const {
+	return channels[ channel ] && ( ( track >= tracks.size()) || ( track >= MAX_TRACK_COUNT ) || tracks[ track ] );
+}
+
+int FilterOptions::hiddenChannelsMask() const {
+	unsigned int mask = 0;
+	for( unsigned int i = 0; i < channels.size(); ++i ){
+		if( !channels[ i ] ){
+			mask |= 1u << i;
+		}
+	}
+	return int( mask );
+}
+
+void FilterOptions::hiddenTracksMask( std::array<int, TRACKS_MASK_SIZE>& mask ) const {
+	std::array<unsigned int, TRACKS_MASK_SIZE> bits;
+	bits.fill( 0 );
+	const size_t trackCount = ( std::min )( tracks.size(), size_t( MAX_TRACK_COUNT ) );
+	for( size_t i = 0; i < trackCount; ++i ){
+		if( !tracks[ i ] ){
+			bits[ i / 32 ] |= 1u << ( i % 32 );
+		}
+	}
+	for( size_t i = 0; i < TRACKS_MASK_SIZE; ++i ){
+		mask[ i ] = int( bits[ i ] );
+	}
+}
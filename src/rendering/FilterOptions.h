@@ -0,0 +1,37 @@
+#ifndef FilterOptions_h
+#define FilterOptions_h
+
+#include <vector>
+#include <array>
+#include <string>
+
+#define MAX_TRACK_COUNT 4096
+// Number of 32 bits words needed to store a bit per track.
+#define TRACKS_MASK_SIZE (MAX_TRACK_COUNT / 32)
+
+struct FilterOptions
+{
+	std::vector<bool> tracks; // Will be resized to max track index + 1
+	std::array<bool, 16> channels;
+
+	FilterOptions();
+
+	void fillChannelsFromTokens( const std::vector<std::string>& list, bool enabled);
+
+	void fillTracksFromTokens( const std::vector<std::string>& list, bool enabled );
+
+	std::string toHiddenChannelsString();
+
+	std::string toHiddenTracksString();
+
+	bool accepts( int track, int channel ) const;
+
+	/// One bit per hidden channel.
+	int hiddenChannelsMask() const;
+
+	/// One bit per hidden track, tracks past MAX_TRACK_COUNT are always visible.
+	void hiddenTracksMask( std::array<int, TRACKS_MASK_SIZE>& mask ) const;
+
+};
+
+#endif
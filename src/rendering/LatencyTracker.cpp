@@ -0,0 +1,227 @@
+#include "../helpers/System.h"
+#include "../midi/MIDIInputQueue.h"
+
+#include "LatencyTracker.h"
+
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+
+LatencyHistogram::LatencyHistogram(){
+	_bins.resize(LATENCY_BIN_COUNT, 0);
+}
+
+void LatencyHistogram::add(double milliseconds){
+	milliseconds = (std::max)(milliseconds, 0.0);
+	const size_t bin = (std::min)(size_t(milliseconds / LATENCY_BIN_SIZE), size_t(LATENCY_BIN_COUNT - 1));
+	++_bins[bin];
+	++_count;
+	_max = (std::max)(_max, milliseconds);
+}
+
+double LatencyHistogram::percentile(double fraction) const {
+	if(_count == 0){
+		return 0.0;
+	}
+	const uint64_t target = (std::max)(uint64_t(1), uint64_t(std::ceil(fraction * double(_count))));
+	uint64_t total = 0;
+	for(size_t bid = 0; bid < _bins.size(); ++bid){
+		total += _bins[bid];
+		if(total >= target){
+			// The last bin is unbounded.
+			return bid + 1 == _bins.size() ? _max : double(bid + 1) * LATENCY_BIN_SIZE;
+		}
+	}
+	return _max;
+}
+
+uint64_t LatencyHistogram::countInRange(double start, double end) const {
+	const size_t first = (std::min)(size_t((std::max)(start, 0.0) / LATENCY_BIN_SIZE), _bins.size());
+	const size_t last = (std::min)(size_t((std::max)(end, 0.0) / LATENCY_BIN_SIZE), _bins.size());
+	uint64_t total = 0;
+	for(size_t bid = first; bid < last; ++bid){
+		total += _bins[bid];
+	}
+	return total;
+}
+
+void LatencyHistogram::clear(){
+	std::fill(_bins.begin(), _bins.end(), 0);
+	_count = 0;
+	_max = 0.0;
+}
+
+const std::array<std::string, LatencyTracker::COUNT> LatencyTracker::stageNames = {"consumed", "uploaded", "presented", "completed"};
+
+void LatencyTracker::init(){
+	_timerQueries = gl3wIsSupported(3, 3) != 0;
+	if(!_timerQueries){
+		GLint extensionCount = 0;
+		glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+		for(GLint eid = 0; eid < extensionCount && !_timerQueries; ++eid){
+			const GLubyte* name = glGetStringi(GL_EXTENSIONS, GLuint(eid));
+			_timerQueries = name != nullptr && std::string((const char*)name) == "GL_ARB_timer_query";
+		}
+	}
+	// The extension entry points have the same names as in GL 3.3.
+	_timerQueries = _timerQueries && glQueryCounter != nullptr && glGetQueryObjectui64v != nullptr && glGetInteger64v != nullptr;
+	if(!_timerQueries){
+		std::cout << "[INFO]: GPU timestamps not supported, frame completion will be measured with fences." << std::endl;
+	}
+}
+
+void LatencyTracker::consume(const std::vector<double> & arrivals){
+	_arrivals = arrivals;
+	reach(CONSUMED);
+}
+
+void LatencyTracker::reach(Stage stage){
+	if(_arrivals.empty()){
+		return;
+	}
+	const double now = MIDIInputQueue::now();
+	for(const double arrival : _arrivals){
+		_histograms[stage].add((now - arrival) * 1000.0);
+	}
+}
+
+void LatencyTracker::present(){
+	if(_arrivals.empty()){
+		return;
+	}
+	reach(PRESENTED);
+	// Abandon the oldest frame if the GPU is far behind.
+	if(_pending.size() >= LATENCY_MAX_PENDING_FRAMES){
+		release(_pending.front());
+		_pending.pop_front();
+	}
+	PendingFrame frame;
+	if(_timerQueries){
+		if(_freeQueries.empty()){
+			GLuint query = 0;
+			glGenQueries(1, &query);
+			_freeQueries.push_back(query);
+		}
+		frame.query = _freeQueries.back();
+		_freeQueries.pop_back();
+		// Recorded once all previous commands, including the presented frame, are complete.
+		glQueryCounter(frame.query, GL_TIMESTAMP);
+	} else {
+		frame.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+	}
+	frame.arrivals.swap(_arrivals);
+	if(frame.query != 0 || frame.fence != nullptr){
+		// Make sure the query or fence is submitted, so that it can be signaled.
+		glFlush();
+		_pending.push_back(std::move(frame));
+	}
+	_arrivals.clear();
+}
+
+void LatencyTracker::poll(){
+	while(!_pending.empty()){
+		PendingFrame & frame = _pending.front();
+		double completion = 0.0;
+		if(!completed(frame, completion)){
+			return;
+		}
+		if(completion >= 0.0){
+			for(const double arrival : frame.arrivals){
+				_histograms[COMPLETED].add((completion - arrival) * 1000.0);
+			}
+		}
+		release(frame);
+		_pending.pop_front();
+	}
+}
+
+bool LatencyTracker::completed(const PendingFrame & frame, double & time) const {
+	if(frame.query != 0){
+		GLint available = 0;
+		glGetQueryObjectiv(frame.query, GL_QUERY_RESULT_AVAILABLE, &available);
+		if(available == 0){
+			return false;
+		}
+		GLuint64 frameTime = 0;
+		glGetQueryObjectui64v(frame.query, GL_QUERY_RESULT, &frameTime);
+		// Convert from GPU time to our clock, using the current time on both.
+		GLint64 gpuTime = 0;
+		glGetInteger64v(GL_TIMESTAMP, &gpuTime);
+		time = MIDIInputQueue::now() - double(gpuTime - GLint64(frameTime)) * 1e-9;
+		return true;
+	}
+	const GLenum status = glClientWaitSync(frame.fence, 0, 0);
+	if(status == GL_TIMEOUT_EXPIRED){
+		return false;
+	}
+	time = status == GL_WAIT_FAILED ? -1.0 : MIDIInputQueue::now();
+	return true;
+}
+
+void LatencyTracker::release(PendingFrame & frame){
+	if(frame.query != 0){
+		_freeQueries.push_back(frame.query);
+		frame.query = 0;
+	}
+	if(frame.fence != nullptr){
+		glDeleteSync(frame.fence);
+		frame.fence = nullptr;
+	}
+}
+
+bool LatencyTracker::save(const std::string & path) const {
+	std::ofstream output = System::openOutputFile(path);
+	if(!output.is_open()){
+		std::cerr << "[ERROR]: Unable to write latency statistics to " << path << std::endl;
+		return false;
+	}
+	output << "stage,count,p50_ms,p95_ms,p99_ms,max_ms\n";
+	for(int sid = 0; sid < COUNT; ++sid){
+		const LatencyHistogram & histogram = _histograms[sid];
+		output << stageNames[sid] << "," << histogram.count() << "," << histogram.percentile(0.5) << "," << histogram.percentile(0.95) << ",";
+		output << histogram.percentile(0.99) << "," << histogram.max() << "\n";
+	}
+	// Histograms, up to the last non-empty bin.
+	size_t binCount = 0;
+	for(const LatencyHistogram & histogram : _histograms){
+		const std::vector<uint64_t> & bins = histogram.bins();
+		for(size_t bid = bins.size(); bid > binCount; --bid){
+			if(bins[bid - 1] != 0){
+				binCount = bid;
+				break;
+			}
+		}
+	}
+	output << "\nbin_start_ms";
+	for(const std::string & name : stageNames){
+		output << "," << name;
+	}
+	output << "\n";
+	for(size_t bid = 0; bid < binCount; ++bid){
+		output << double(bid) * LATENCY_BIN_SIZE;
+		for(const LatencyHistogram & histogram : _histograms){
+			output << "," << histogram.bins()[bid];
+		}
+		output << "\n";
+	}
+	output.close();
+	return true;
+}
+
+void LatencyTracker::clear(){
+	for(LatencyHistogram & histogram : _histograms){
+		histogram.clear();
+	}
+}
+
+void LatencyTracker::clean(){
+	for(PendingFrame & frame : _pending){
+		release(frame);
+	}
+	_pending.clear();
+	if(!_freeQueries.empty()){
+		glDeleteQueries(GLsizei(_freeQueries.size()), _freeQueries.data());
+		_freeQueries.clear();
+	}
+	_arrivals.clear();
+}
@@ -0,0 +1,102 @@
+#pragma once
+#include <gl3w/gl3w.h>
+
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <string>
+#include <vector>
+
+// Width of a latency histogram bin, in milliseconds.
+#define LATENCY_BIN_SIZE 0.1
+// Number of bins, the last one also collects longer latencies.
+#define LATENCY_BIN_COUNT 2500
+// Frames waiting for the GPU before their fence is abandoned.
+#define LATENCY_MAX_PENDING_FRAMES 8
+
+/// Distribution of latencies, in fixed-size bins.
+class LatencyHistogram {
+public:
+
+	LatencyHistogram();
+
+	void add(double milliseconds);
+
+	/// Upper bound of the bin containing the given fraction of latencies, in milliseconds.
+	double percentile(double fraction) const;
+
+	/// Number of latencies in the bins covering [start, end[ milliseconds.
+	uint64_t countInRange(double start, double end) const;
+
+	uint64_t count() const { return _count; }
+
+	double max() const { return _max; }
+
+	const std::vector<uint64_t> & bins() const { return _bins; }
+
+	void clear();
+
+private:
+
+	std::vector<uint64_t> _bins;
+	uint64_t _count = 0;
+	double _max = 0.0;
+};
+
+/// Measure the time from the arrival of live notes to their display, at each step of a frame.
+class LatencyTracker {
+public:
+
+	enum Stage : int {
+		CONSUMED = 0, ///< Processed by the scene.
+		UPLOADED, ///< Sent to the GPU.
+		PRESENTED, ///< Swap buffers returned.
+		COMPLETED, ///< The GPU finished the frame, timestamped by the GPU if supported, else detected at the start of a following frame.
+		COUNT
+	};
+
+	/// Check support for GPU timestamps, requires a GL context.
+	void init();
+
+	/// Start tracking notes processed in the current frame, with their arrival times (see MIDIInputQueue::now).
+	void consume(const std::vector<double> & arrivals);
+
+	/// Register the current time for notes processed in the current frame.
+	void reach(Stage stage);
+
+	/// Register presentation of the current frame, and insert a timestamp query or a fence checked by poll().
+	void present();
+
+	/// Check if the GPU has completed previous frames, without blocking.
+	void poll();
+
+	const LatencyHistogram & histogram(Stage stage) const { return _histograms[stage]; }
+
+	/// Write percentiles and histograms of all stages as CSV.
+	bool save(const std::string & path) const;
+
+	void clear();
+
+	void clean();
+
+	static const std::array<std::string, COUNT> stageNames;
+
+private:
+
+	struct PendingFrame {
+		GLsync fence = nullptr;
+		GLuint query = 0; ///< Timestamp query, used instead of the fence if supported.
+		std::vector<double> arrivals;
+	};
+
+	/// Check if the GPU is done with a frame, and if so when it completed it (negative if unknown).
+	bool completed(const PendingFrame & frame, double & time) const;
+
+	void release(PendingFrame & frame);
+
+	std::vector<double> _arrivals; ///< Notes processed in the current frame.
+	std::deque<PendingFrame> _pending;
+	std::array<LatencyHistogram, COUNT> _histograms;
+	std::vector<GLuint> _freeQueries; ///< Timestamp queries available for reuse.
+	bool _timerQueries = false; ///< GL 3.3 or ARB_timer_query.
+};
@@ -49,6 +49,13 @@ void Renderer::renderSetup(){
 	glBindBuffer(GL_ARRAY_BUFFER, _keysDataBuffer);
 	glBufferData(GL_ARRAY_BUFFER, sizeof(int) * 128, nullptr, GL_DYNAMIC_DRAW);
 
+	// Running particle systems (empty for now).
+	_particlesDataBuffer = 0;
+	glGenBuffers(1, &_particlesDataBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, _particlesDataBuffer);
+	_particlesDataCapacity = 256;
+	glBufferData(GL_ARRAY_BUFFER, sizeof(GPUParticleSystem) * _particlesDataCapacity, nullptr, GL_DYNAMIC_DRAW);
+
 	// -- Wave strips
 	const int numSegments = 512;
 	std::vector<glm::vec2> waveVerts((numSegments+1)*2);
@@ -109,10 +116,10 @@ void Renderer::renderSetup(){
 	glBindBuffer(GL_ARRAY_BUFFER, _notesDataBuffer);
 	glVertexAttribPointer(1, 4, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), NULL);
 	glVertexAttribDivisor(1, 1);
-	// Notes data part 2
+	// Notes data part 2, packed attributes
 	glEnableVertexAttribArray(2);
 	glBindBuffer(GL_ARRAY_BUFFER, _notesDataBuffer);
-	glVertexAttribPointer(2, 1, GL_FLOAT, GL_FALSE, 5 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
+	glVertexAttribIPointer(2, 1, GL_UNSIGNED_INT, 5 * sizeof(GLfloat), (void*)(4 * sizeof(GLfloat)));
 	glVertexAttribDivisor(2, 1);
 	// Indices
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quadIndices);
@@ -135,6 +142,27 @@ void Renderer::renderSetup(){
 	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quadIndices);
 	glBindVertexArray(0);
 
+	// -- Quad with particle systems data.
+	glGenVertexArrays(1, &_vaoQuadWithParticlesData);
+	glBindVertexArray(_vaoQuadWithParticlesData);
+	// Positions
+	glEnableVertexAttribArray(0);
+	glBindBuffer(GL_ARRAY_BUFFER, _quadVertices);
+	glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 0, NULL);
+	glVertexAttribDivisor(0, 0);
+	// Systems data part 1, elapsed time and duration
+	// The divisor is set when drawing, to the number of particles in each system.
+	glEnableVertexAttribArray(1);
+	glBindBuffer(GL_ARRAY_BUFFER, _particlesDataBuffer);
+	glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, sizeof(GPUParticleSystem), NULL);
+	// Systems data part 2, note and set
+	glEnableVertexAttribArray(2);
+	glBindBuffer(GL_ARRAY_BUFFER, _particlesDataBuffer);
+	glVertexAttribIPointer(2, 2, GL_INT, sizeof(GPUParticleSystem), (void*)(2 * sizeof(GLfloat)));
+	// Indices
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, _quadIndices);
+	glBindVertexArray(0);
+
 	// -- Wave
 	glGenVertexArrays(1, &_vaoWave);
 	glBindVertexArray(_vaoWave);
@@ -178,8 +206,14 @@ void Renderer::upload(const std::shared_ptr<MIDIScene>& scene){
 		constexpr size_t noteSize = sizeof(MIDIScene::GPUNote);
 		const auto& notes = scene->getNotes();
 		glBindBuffer(GL_ARRAY_BUFFER, _notesDataBuffer);
-		if(uploadRange.y == 0){ // Full vector
-			glBufferData(GL_ARRAY_BUFFER, noteSize * notes.size(), &(notes[0]), GL_DYNAMIC_DRAW);
+		// Ranges past the end of the buffer require a full upload.
+		if(uploadRange.y == 0 || size_t(uploadRange.y) >= _notesDataCapacity){ // Full vector
+			// Allocate for the whole vector capacity, so that appended notes can be uploaded in place.
+			_notesDataCapacity = notes.capacity();
+			glBufferData(GL_ARRAY_BUFFER, noteSize * _notesDataCapacity, nullptr, GL_DYNAMIC_DRAW);
+			if(!notes.empty()){
+				glBufferSubData(GL_ARRAY_BUFFER, 0, noteSize * notes.size(), notes.data());
+			}
 		} else {
 			const int size = uploadRange.y - uploadRange.x + 1;
 			const int first = uploadRange.x;
@@ -189,6 +223,37 @@ void Renderer::upload(const std::shared_ptr<MIDIScene>& scene){
 		scene->setUpToDate();
 	}
 
+	// Sets and visibility are resolved per note when rendering.
+	if(scene->dirtyFilter()){
+		const auto& filter = scene->getFilter();
+		_programNotes.use();
+		_programNotes.uniform("setMode", filter.setMode);
+		// Arrays are packed in vectors, as each array element uses a full uniform slot.
+		_programNotes.uniforms("keySets", filter.keySets.size() / 4, (const glm::ivec4*)filter.keySets.data());
+		_programNotes.uniform("hiddenChannels", filter.hiddenChannels);
+		_programNotes.uniforms("hiddenTracks", filter.hiddenTracks.size() / 4, (const glm::ivec4*)filter.hiddenTracks.data());
+		glUseProgram(0);
+		scene->setFilterUpToDate();
+	}
+
+	// Running particle systems, shared by the blur prepass and the main pass.
+	const auto& particles = scene->getParticles();
+	const auto& runningParticles = scene->getRunningParticles();
+	_particlesData.resize(runningParticles.size());
+	for(size_t rid = 0; rid < runningParticles.size(); ++rid){
+		const auto & particle = particles[runningParticles[rid]];
+		_particlesData[rid] = {particle.elapsed, particle.duration, particle.note, particle.set};
+	}
+	if(!_particlesData.empty()){
+		glBindBuffer(GL_ARRAY_BUFFER, _particlesDataBuffer);
+		if(_particlesData.size() > _particlesDataCapacity){
+			_particlesDataCapacity = _particlesData.capacity();
+			glBufferData(GL_ARRAY_BUFFER, sizeof(GPUParticleSystem) * _particlesDataCapacity, nullptr, GL_DYNAMIC_DRAW);
+		}
+		glBufferSubData(GL_ARRAY_BUFFER, 0, sizeof(GPUParticleSystem) * _particlesData.size(), _particlesData.data());
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+
 	// Update the flags buffer accordingly.
 	const auto& actives = scene->getActiveKeys();
 	glBindBuffer(GL_ARRAY_BUFFER, _keysDataBuffer);
@@ -285,14 +350,14 @@ void Renderer::setOrientation(bool horizontal){
 	glUseProgram(0);
 }
 
-void Renderer::drawParticles(const std::shared_ptr<MIDIScene>& scene, float time, const glm::vec2 & invScreenSize, const State::ParticlesState & state, bool prepass){
+void Renderer::drawParticles(const glm::vec2 & invScreenSize, const State::ParticlesState & state, bool prepass){
 
 	glEnable(GL_BLEND);
 	_programParticules.use();
 	
 	// Common uniforms values.
 	_programParticules.uniform("inverseScreenSize", invScreenSize);
-	_programParticules.uniform("time", 0.0f);
+	_programParticules.uniform("particlesPerSystem", state.count);
 
 	// Prepass : bigger, darker particles.
 	_programParticules.uniform("colorScale", prepass ? 0.6f : 1.6f);
@@ -308,17 +373,12 @@ void Renderer::drawParticles(const std::shared_ptr<MIDIScene>& scene, float time
 	_programParticules.uniform("turbulenceScale", state.turbulenceScale);
 	_programParticules.uniform("texCount", state.texCount);
 
-	// Select the geometry.
-	glBindVertexArray(_vaoQuad);
-	// For each active particles system, draw it with the right parameters.
-	for(const auto & particle : scene->getParticles()){
-		if(particle.note >= 0){
-			_programParticules.uniform("globalId", particle.note);
-			_programParticules.uniform("time", particle.elapsed);
-			_programParticules.uniform("duration", particle.duration);
-			_programParticules.uniform("channel", particle.set);
-			glDrawElementsInstanced(GL_TRIANGLES, int(_quadPrimitiveCount), GL_UNSIGNED_INT, (void*)0, state.count);
-		}
+	// Draw all particles of all running systems at once, each system parameters are shared by its particles.
+	if(!_particlesData.empty()){
+		glBindVertexArray(_vaoQuadWithParticlesData);
+		glVertexAttribDivisor(1, GLuint(state.count));
+		glVertexAttribDivisor(2, GLuint(state.count));
+		glDrawElementsInstanced(GL_TRIANGLES, int(_quadPrimitiveCount), GL_UNSIGNED_INT, (void*)0, GLsizei(_particlesData.size()) * state.count);
 	}
 	
 	glBindVertexArray(0);
@@ -693,8 +753,8 @@ void Renderer::drawScore(const std::shared_ptr<MIDIScene>& scene, float time, co
 }
 
 void Renderer::clean(){
-	GLuint vaos[] = {_vaoQuad, _vaoQuadWithNoteData, _vaoQuadWithKeyData, _vaoWave};
-	GLuint buffers[] = {_quadVertices, _quadIndices, _waveVertices, _waveIndices, _notesDataBuffer, _keysDataBuffer };
+	GLuint vaos[] = {_vaoQuad, _vaoQuadWithNoteData, _vaoQuadWithKeyData, _vaoQuadWithParticlesData, _vaoWave};
+	GLuint buffers[] = {_quadVertices, _quadIndices, _waveVertices, _waveIndices, _notesDataBuffer, _keysDataBuffer, _particlesDataBuffer };
 	glDeleteVertexArrays(sizeof(vaos)/sizeof(vaos[0]), vaos);
 	glDeleteBuffers(sizeof(buffers)/sizeof(buffers[0]), buffers);
 
@@ -36,7 +36,7 @@ public:
 	
 	void drawFlashes(const std::shared_ptr<MIDIScene>& scene, float time, const glm::vec2 & invScreenSize, const State::FlashesState& state);
 	
-	void drawParticles(const std::shared_ptr<MIDIScene>& scene, float time, const glm::vec2 & invScreenSize, const State::ParticlesState & state, bool prepass);
+	void drawParticles(const glm::vec2 & invScreenSize, const State::ParticlesState & state, bool prepass);
 	
 	void drawKeyboard(const std::shared_ptr<MIDIScene>& scene, float time, const glm::vec2 & invScreenSize, const glm::vec3 & edgeColor, const glm::vec3 & keyColor, const ColorArray & majorColors, const ColorArray & minorColors, bool highlightKeys);
 
@@ -49,6 +49,14 @@ public:
 	void clean();
 
 private:
+
+	// Parameters of a running particle system, shared by all its particles.
+	struct GPUParticleSystem {
+		float elapsed;
+		float duration;
+		int note;
+		int set;
+	};
 	
 	ShaderProgram _programNotes;
 	ShaderProgram _programFlashes;
@@ -62,7 +70,11 @@ private:
 	ShaderProgram _programScoreLabels;
 
 	GLuint _notesDataBuffer;
+	size_t _notesDataCapacity = 0; ///< Number of notes the GPU buffer can store.
 	GLuint _keysDataBuffer;
+	GLuint _particlesDataBuffer;
+	size_t _particlesDataCapacity = 0; ///< Number of particle systems the GPU buffer can store.
+	std::vector<GPUParticleSystem> _particlesData; ///< Running particle systems of the current frame.
 	GLuint _quadVertices;
 	GLuint _quadIndices;
 	GLuint _waveVertices;
@@ -71,6 +83,7 @@ private:
 	GLuint _vaoQuad;
 	GLuint _vaoQuadWithNoteData;
 	GLuint _vaoQuadWithKeyData;
+	GLuint _vaoQuadWithParticlesData;
 	size_t _quadPrimitiveCount;
 
 	GLuint _vaoWave;
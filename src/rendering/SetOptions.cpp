@@ -11,23 +11,52 @@ SetOptions::SetOptions(){
 }
 
 void SetOptions::rebuild(){
-	// Reset
-	_firstNonEmptySet = SETS_COUNT;
-	_lastNonEmptySet = -1;
-	for(unsigned int sid = 0; sid < SETS_COUNT; ++sid){
-		_keysPerSet[sid].clear();
-		_keysPerSet[sid].reserve(keys.size());
-	}
-
 	// Sort reference keys.
 	std::sort(keys.begin(), keys.end());
 
+	std::array<KeyFrames, SETS_COUNT> keysPerSet;
+	int firstNonEmptySet = SETS_COUNT;
+	int lastNonEmptySet = -1;
+	_listTimes.clear();
 	for(const KeyFrame& key : keys){
 		// Insert in subset, they are already sorted.
-		_keysPerSet[key.set].push_back(key);
+		keysPerSet[key.set].push_back(key);
 		// Keep track of bounds.
-		_firstNonEmptySet = (std::min)(_firstNonEmptySet, key.set);
-		_lastNonEmptySet  = (std::max)( _lastNonEmptySet, key.set);
+		firstNonEmptySet = (std::min)(firstNonEmptySet, key.set);
+		lastNonEmptySet  = (std::max)( lastNonEmptySet, key.set);
+		if(_listTimes.empty() || _listTimes.back() != key.time){
+			_listTimes.push_back(key.time);
+		}
+	}
+
+	// Between two key times, the set of a note only depends on its key: build a lookup table for each interval.
+	_listSets.resize(_listTimes.size() + 1);
+	std::array<size_t, SETS_COUNT> startedKeys;
+	startedKeys.fill(0);
+	std::array<int, SETS_COUNT> setKeys;
+	setKeys.fill(0);
+	for(size_t iid = 0; iid < _listSets.size(); ++iid){
+		for(int sid = firstNonEmptySet; sid <= lastNonEmptySet; ++sid){
+			const KeyFrames& setFrames = keysPerSet[sid];
+			if(setFrames.empty()){
+				continue;
+			}
+			// Use the last key started, or the first one before it starts.
+			while(iid > 0 && startedKeys[sid] < setFrames.size() && setFrames[startedKeys[sid]].time <= _listTimes[iid - 1]){
+				++startedKeys[sid];
+			}
+			setKeys[sid] = setFrames[(std::max)(startedKeys[sid], size_t(1)) - 1].key;
+		}
+		// Each note goes in the first set whose key is above it.
+		for(int note = 0; note < 128; ++note){
+			int sid = firstNonEmptySet;
+			for(; sid <= lastNonEmptySet; ++sid){
+				if(!keysPerSet[sid].empty() && note < setKeys[sid]){
+					break;
+				}
+			}
+			_listSets[iid][note] = uint8_t(glm::clamp(sid, firstNonEmptySet, lastNonEmptySet + 1) % SETS_COUNT);
+		}
 	}
 }
 
@@ -45,29 +74,9 @@ int SetOptions::apply(int note, int channel, int track, double start) const {
 			return (note % 12) % SETS_COUNT;
 		case SetMode::LIST:
 		{
-			// For each channel, find the corresponding key, and test
-			int sid = _firstNonEmptySet;
-			for(; sid <= _lastNonEmptySet; ++sid){
-				const int keyCount = int(_keysPerSet[sid].size());
-				if(keyCount == 0){
-					// Ignore this set.
-					continue;
-				}
-				// TODO: (MV) binary search instead.
-				int kid = 0;
-				for( ; kid < keyCount; ++kid){
-					if(start < _keysPerSet[sid][kid].time){
-						// We found the key after.
-						break;
-					}
-				}
-				kid = (std::max)(0, kid - 1);
-				if(note < _keysPerSet[sid][kid].key){
-					break;
-				}
-
-			}
-			return glm::clamp(sid, _firstNonEmptySet, _lastNonEmptySet + 1) % SETS_COUNT;
+			// Keys starting exactly at the note start apply to it.
+			const size_t interval = std::upper_bound(_listTimes.begin(), _listTimes.end(), start) - _listTimes.begin();
+			return _listSets[interval][glm::clamp(note, 0, 127)];
 		}
 		default:
 			assert(false);
@@ -4,6 +4,7 @@
 #include <vector>
 #include <array>
 #include <string>
+#include <cstdint>
 
 #define SETS_COUNT 12
 
@@ -44,9 +45,8 @@ struct SetOptions {
 
 private:
 
-	std::array<KeyFrames, SETS_COUNT> _keysPerSet;
-	int _firstNonEmptySet = SETS_COUNT;
-	int _lastNonEmptySet = -1;
+	std::vector<double> _listTimes; ///< Times at which a set key changes, sorted.
+	std::vector<std::array<uint8_t, 128>> _listSets; ///< Set of each key before the first time, then after each time.
 };
 
 inline bool operator <(const SetOptions::KeyFrame& a, const SetOptions::KeyFrame& b){
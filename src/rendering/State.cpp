@@ -10,8 +10,6 @@
 #include <sstream>
 #include <algorithm>
 
-#define MAX_TRACK_COUNT 4096
-
 std::unordered_map<std::string, State::OptionInfos> State::_sharedInfos;
 
 // Quality names.
@@ -41,71 +39,6 @@ Quality::Quality(const Quality::Level & alevel, const float partRes, const float
 	particlesResolution = partRes; blurResolution = blurRes; finalResolution = finRes;
 }
 
-FilterOptions::FilterOptions(){
-	channels.fill( true );
-}
-
-void FilterOptions::fillChannelsFromTokens( const std::vector<std::string>& list, bool enabled ){
-	for( const std::string& token : list ){
-		if( token.empty() ){
-			continue;
-		}
-		int index = Configuration::parseInt( token );
-		if( index < 0 || index >= channels.size() ){
-			continue;
-		}
-		channels[ index ] = enabled;
-	}
-}
-
-void FilterOptions::fillTracksFromTokens( const std::vector<std::string>& list, bool enabled ){
-	for( const std::string& token : list ){
-		if( token.empty() ){
-			continue;
-		}
-		int index = Configuration::parseInt( token );
-		if( index < 0 || index >= MAX_TRACK_COUNT ){
-			continue;
-		}
-		const size_t newMaxTrack = ( std::max )( tracks.size(), size_t( index ) + 1 );
-		// All new tracks are assumed visible.
-		tracks.resize( newMaxTrack, true );
-		tracks[ index ] = enabled;
-	}
-}
-
-std::string FilterOptions::toHiddenChannelsString(){
-	std::vector<unsigned int> hiddenChannels;
-	hiddenChannels.reserve( channels.size() );
-	for( unsigned int i = 0; i < channels.size(); ++i )
-		if( !channels[ i ] )
-			hiddenChannels.push_back( i );
-
-	std::stringstream str;
-	for( unsigned int chan : hiddenChannels ){
-		str << chan << " ";
-	}
-	return str.str();
-}
-
-std::string FilterOptions::toHiddenTracksString(){
-	std::vector<unsigned int> hiddenTracks;
-	hiddenTracks.reserve( tracks.size() );
-	for( unsigned int i = 0; i < tracks.size(); ++i )
-		if( !tracks[ i ] )
-			hiddenTracks.push_back( i );
-
-	std::stringstream str;
-	for( unsigned int track : hiddenTracks ){
-		str << track << " ";
-	}
-	return str.str();
-}
-
-bool FilterOptions::accepts( int track, int channel ) const {
-	return channels[ channel ] && ( ( track >= tracks.size()) || tracks[ track ] );
-}
-
 State::OptionInfos::OptionInfos(){
 	description = "";
 	type = Type::OTHER;
@@ -175,6 +108,9 @@ void State::defineOptions(){
 	_sharedInfos[s_min_key_key] 						= {Category::GENERAL, s_min_key_dsc, Type::KEY, {0.0f, 127.0f}};
 	_sharedInfos[s_max_key_key] 						= {Category::GENERAL, s_max_key_dsc, Type::KEY, {0.0f, 127.0f}};
 	_sharedInfos[s_smooth_key] 							= {Category::GENERAL, s_smooth_dsc, Type::BOOLEAN};
+	_sharedInfos[s_notes_pairing_key] 					= {Category::GENERAL, s_notes_pairing_dsc, Type::OTHER, {0.0f, 2.0f}};
+	_sharedInfos[s_notes_pairing_key].values 			= "new note restarts the key: 0, first-in first-out: 1, last-in first-out: 2";
+	_sharedInfos[s_load_streaming_key] 					= {Category::GENERAL, s_load_streaming_dsc, Type::BOOLEAN};
 
 	// Playback
 	_sharedInfos[s_time_scale_key] 			= {Category::PLAYBACK, s_time_scale_dsc, Type::FLOAT};
@@ -182,6 +118,7 @@ void State::defineOptions(){
 	_sharedInfos[s_scroll_speed_key] 		= {Category::PLAYBACK, s_scroll_speed_dsc, Type::FLOAT};
 	_sharedInfos[s_scroll_reverse_key] 		= {Category::PLAYBACK, s_scroll_reverse_dsc, Type::BOOLEAN};
 	_sharedInfos[s_scroll_horizontal_key] 	= {Category::PLAYBACK, s_scroll_horizontal_dsc, Type::BOOLEAN};
+	_sharedInfos[s_live_history_key] 		= {Category::PLAYBACK, s_live_history_dsc, Type::FLOAT, {1.0f, 86400.0f}};
 
 	// Effects
 	_sharedInfos[s_layers_key] 			= {Category::EFFECTS, s_layers_dsc, Type::OTHER};
@@ -221,6 +158,7 @@ void State::defineOptions(){
 
 	// Particles
 	_sharedInfos[s_particles_count_key] 		= {Category::PARTICLES, s_particles_count_dsc, Type::INTEGER, {1.0f, 512.0f}};
+	_sharedInfos[s_particles_systems_key] 		= {Category::PARTICLES, s_particles_systems_dsc, Type::INTEGER, {1.0f, 16384.0f}};
 	_sharedInfos[s_particles_size_key] 			= {Category::PARTICLES, s_particles_size_dsc, Type::FLOAT, {1.0f, 10.0f}};
 	_sharedInfos[s_particles_speed_key] 		= {Category::PARTICLES, s_particles_speed_dsc, Type::FLOAT};
 	_sharedInfos[s_particles_expansion_key] 	= {Category::PARTICLES, s_particles_expansion_dsc, Type::FLOAT};
@@ -367,6 +305,7 @@ void State::updateOptions(){
 	}
 
 	_intInfos[s_particles_count_key] = &particles.count;
+	_intInfos[s_particles_systems_key] = &particles.systems;
 	_boolInfos[s_show_particles_key] = &showParticles;
 	_boolInfos[s_show_flashes_key] = &showFlashes;
 	_boolInfos[s_show_blur_key] = &showBlur;
@@ -400,6 +339,7 @@ void State::updateOptions(){
 	_floatInfos[s_flashes_halo_intensity_key] = &flashes.haloIntensity;
 	_floatInfos[s_preroll_key] = &prerollTime;
 	_floatInfos[s_scroll_speed_key] = &scrollSpeed;
+	_floatInfos[s_live_history_key] = &liveHistory;
 	_floatInfos[s_bg_img_opacity_key] = &background.imageAlpha;
 	_floatInfos[s_bg_img_scroll_x_key] = &background.scrollSpeed[0];
 	_floatInfos[s_bg_img_scroll_y_key] = &background.scrollSpeed[1];
@@ -442,6 +382,8 @@ void State::updateOptions(){
 
 	_intInfos[s_min_key_key] = &minKey;
 	_intInfos[s_max_key_key] = &maxKey;
+	_intInfos[s_notes_pairing_key] = (int*)&notesPairing;
+	_boolInfos[s_load_streaming_key] = &loadStreaming;
 
 	_boolInfos[s_show_pedal_key] = &showPedal;
 	_floatInfos[s_pedal_size_key] = &pedals.size;
@@ -602,7 +544,7 @@ void State::save(const std::string & path){
 	_filePath = outputPath;
 }
 
-bool State::load(const std::string & path){
+bool State::readConfigFile(const std::string & path, std::stringstream & configFile, int & majVersion, int & minVersion){
 	std::ifstream configFileRaw = System::openInputFile(path);
 	if(!configFileRaw.is_open()){
 		std::cerr << "[CONFIG]: Unable to load state from file at path " << path << std::endl;
@@ -612,7 +554,6 @@ bool State::load(const std::string & path){
 	// Now that we support comments we need to be able to skip them without large code modifications below.
 	// Do a first parse of the file, filtering comments, and build a new stream from it.
 	// Not the most efficient thing, but we are talking about a config file of < 100 lines.
-	std::stringstream configFile;
 	std::string line;
 	while(std::getline(configFileRaw, line)){
 		line = trim(line, "\r\t ");
@@ -624,8 +565,35 @@ bool State::load(const std::string & path){
 	configFileRaw.close();
 
 	// Check the version number.
-	int majVersion = 0; int minVersion = 0;
+	majVersion = 0; minVersion = 0;
 	configFile >> majVersion >> minVersion;
+	return true;
+}
+
+NotePairing State::loadNotesPairing(const std::string & path, const Arguments & configArgs){
+	NotePairing pairing = NotePairing::RETRIGGER;
+	const auto apply = [&pairing](const Arguments & args){
+		const auto value = args.find(s_notes_pairing_key);
+		if(value != args.end() && !value->second.empty()){
+			pairing = NotePairing(glm::clamp(Configuration::parseInt(value->second[0]), 0, 2));
+		}
+	};
+	// Legacy configs don't store the pairing.
+	std::stringstream configFile;
+	int majVersion = 0; int minVersion = 0;
+	if(!path.empty() && readConfigFile(path, configFile, majVersion, minVersion) && majVersion >= 5){
+		apply(Configuration::parseArguments(configFile));
+	}
+	apply(configArgs);
+	return pairing;
+}
+
+bool State::load(const std::string & path){
+	std::stringstream configFile;
+	int majVersion = 0; int minVersion = 0;
+	if(!readConfigFile(path, configFile, majVersion, minVersion)){
+		return false;
+	}
 	
 	if(majVersion > MIDIVIZ_VERSION_MAJOR || (majVersion == MIDIVIZ_VERSION_MAJOR && minVersion > MIDIVIZ_VERSION_MINOR)){
 		std::cout << "[CONFIG]: The config is more recent, some settings might be ignored." << std::endl;
@@ -843,6 +811,7 @@ void State::reset(){
 	particles.expansion = 1.0f;
 	particles.scale = 1.0f;
 	particles.count = 256;
+	particles.systems = 256;
 	particles.imagePaths.clear();
 	const GLuint blankID = ResourcesManager::getTextureFor("blankarray");
 	particles.tex = blankID;
@@ -855,6 +824,7 @@ void State::reset(){
 	quality = Quality::MEDIUM;
 	prerollTime = 1.0f;
 	scrollSpeed = 1.0f;
+	liveHistory = 600.0f;
 	keyboard.highlightKeys = true;
 	keyboard.minorEdges = true;
 	keyboard.customKeyColors = false;
@@ -886,6 +856,8 @@ void State::reset(){
 	
 	minKey = 21;
 	maxKey = 108;
+	notesPairing = NotePairing::RETRIGGER;
+	loadStreaming = false;
 	
 	showPedal = true;
 	pedals.topColor = notes.majorColors[0];
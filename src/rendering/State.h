@@ -3,10 +3,13 @@
 
 #include "../helpers/Configuration.h"
 #include "SetOptions.h"
+#include "FilterOptions.h"
+#include "../midi/MIDIUtils.h"
 
 #include <gl3w/gl3w.h>
 #include <glm/glm.hpp>
 #include <vector>
+#include <sstream>
 #include <string>
 #include <unordered_map>
 #include <array>
@@ -42,26 +45,6 @@ struct Quality {
 	Quality(const Quality::Level & alevel, const float partRes, const float blurRes, const float finRes);
 };
 	
-struct FilterOptions
-{
-	std::vector<bool> tracks; // Will be resized to max track index + 1
-	std::array<bool, 16> channels;
-
-	FilterOptions();
-
-	void fillChannelsFromTokens( const std::vector<std::string>& list, bool enabled);
-
-	void fillTracksFromTokens( const std::vector<std::string>& list, bool enabled );
-
-	std::string toHiddenChannelsString();
-
-	std::string toHiddenTracksString();
-
-	bool accepts( int track, int channel ) const;
-
-};
-
-
 class State {
 public:
 	struct BackgroundState {
@@ -97,6 +80,7 @@ public:
 		float expansion; ///< Expansion factor.
 		float scale; ///< Particles scale.
 		int count; ///< Number of particles.
+		int systems; ///< Maximum number of particle systems running at once.
 		float turbulenceScale; ///< Turbulence noise scale (not exposed)
 		float turbulenceStrength; ///< Turbulence intensity
 	};
@@ -198,9 +182,12 @@ public:
 
 	float prerollTime; ///< Preroll time.
 	float scrollSpeed; ///< Playback speed.
+	float liveHistory; ///< Controllers history kept in live mode, in seconds.
 
 	int minKey; ///< The lowest key to display.
 	int maxKey; ///< The highest key to display.
+	NotePairing notesPairing; ///< Overlapping notes handling when loading.
+	bool loadStreaming; ///< Load files progressively.
 
 	bool showParticles;
 	bool showFlashes;
@@ -235,8 +222,14 @@ public:
 
 	static size_t helpText(std::string & configOpts);
 
+	/// Overlapping notes handling resulting from loading a config file then arguments, without creating a state.
+	static NotePairing loadNotesPairing(const std::string & path, const Arguments & configArgs);
+
 private:
 
+	/// Read a config file without comments, and its version.
+	static bool readConfigFile(const std::string & path, std::stringstream & configFile, int & majVersion, int & minVersion);
+
 	static void defineOptions();
 
 	void updateOptions();
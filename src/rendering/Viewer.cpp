@@ -16,6 +16,7 @@
 #include "scene/MIDIScene.h"
 #include "scene/MIDISceneFile.h"
 #include "scene/MIDISceneLive.h"
+#include "../midi/MIDIDeviceSource.h"
 
 #include <algorithm>
 #include <fstream>
@@ -34,6 +35,8 @@ Viewer::Viewer(const Configuration& config) :
 	_fullscreen = config.fullscreen;
 	_windowSize = config.windowSize;
 	_useTransparency = config.useTransparency && _supportTransparency;
+	_cachePath = config.cachePath;
+	_journalPath = config.journalPath;
 
 	// GL options
 	glEnable(GL_CULL_FACE);
@@ -46,6 +49,7 @@ Viewer::Viewer(const Configuration& config) :
 	glClearColor(0.0f, 0.0f, 0.0f, 1.0f);
 	glPixelStorei(GL_PACK_ALIGNMENT, 1);
 	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	_latency.init();
 
 	_camera.screen(config.windowSize[0], config.windowSize[1], 1.0f);
 	_backbufferSize = glm::vec2(config.windowSize);
@@ -133,7 +137,14 @@ bool Viewer::loadFile(const std::string& midiFilePath) {
 	std::shared_ptr<MIDIScene> scene(nullptr);
 
 	try {
-		scene = std::make_shared<MIDISceneFile>(midiFilePath, _state.setOptions, _state.filter);
+		// Only notes and pedals are needed for display.
+		MIDILoadOptions loadOptions;
+		loadOptions.releaseEvents = true;
+		loadOptions.selectiveDecode = true;
+		loadOptions.notePairing = _state.notesPairing;
+		loadOptions.streaming = _state.loadStreaming;
+		loadOptions.cacheDirectory = _cachePath;
+		scene = std::make_shared<MIDISceneFile>(midiFilePath, loadOptions, _state.setOptions, _state.filter);
 	} catch(...){
 		// Failed to load.
 		return false;
@@ -153,7 +164,7 @@ bool Viewer::connectDevice(const std::string& deviceName) {
 	std::shared_ptr<MIDIScene> scene(nullptr);
 	_selectedPort = -1;
 	
-	const auto & devices = MIDISceneLive::availablePorts(true);
+	const auto & devices = MIDIDeviceSource::availablePorts(true);
 	for(int i = 0; i < devices.size(); ++i){
 		if(devices[i] == deviceName){
 			_selectedPort = i;
@@ -167,20 +178,60 @@ bool Viewer::connectDevice(const std::string& deviceName) {
 		}
 	}
 
-	_scene = std::make_shared<MIDISceneLive>(_selectedPort, _verbose);
+	connectSource(std::make_unique<MIDIDeviceSource>(_selectedPort), false);
+	return true;
+}
+
+void Viewer::connectSource(std::unique_ptr<MIDIInputSource> source, bool play){
+	_scene = std::make_shared<MIDISceneLive>(std::move(source), _journalPath, _verbose);
 	_timer = 0.0f;
-	// Don't start immediately
-	// _shouldPlay = true;
+	// Don't start immediately for devices.
+	_shouldPlay = play;
 	_state.reverseScroll = true;
 	_state.scrollSpeed = 1.0f;
 	_liveplay = true;
+	_liveStart = float(glfwGetTime());
+	_latency.clear();
+	_liveUpdateTimes.clear();
 	applyAllSettings();
+}
 
-	return true;
+void Viewer::setLiveDuration(float duration, const std::string & reportPath){
+	_liveDuration = duration;
+	_liveReportPath = reportPath;
+}
+
+void Viewer::reportLiveSession(){
+	std::shared_ptr<MIDISceneLive> liveScene = std::dynamic_pointer_cast<MIDISceneLive>(_scene);
+	if(!liveScene){
+		return;
+	}
+	const MIDIInputQueue::Stats stats = liveScene->inputStats();
+	std::cout << "[INFO]: Live session from " << liveScene->deviceName() << ": " << stats.received << " messages, " << stats.dropped << " dropped, " << liveScene->notesCount() << " notes." << std::endl;
+	std::cout << "[INFO]: Scene update: p50 " << _liveUpdateTimes.percentile(0.5) << "ms, p99 " << _liveUpdateTimes.percentile(0.99) << "ms, max " << _liveUpdateTimes.max() << "ms over " << _liveUpdateTimes.count() << " frames." << std::endl;
+	const MIDISceneLive::TimingStats & timing = liveScene->timingStats();
+	std::cout << "[INFO]: Timing jitter: p50 " << timing.jitter.percentile(0.5) << "ms, p99 " << timing.jitter.percentile(0.99) << "ms, max " << timing.jitter.max() << "ms; frame offset: p50 " << timing.frameOffsets.percentile(0.5) << "ms, p99 " << timing.frameOffsets.percentile(0.99) << "ms." << std::endl;
+	for(int sid = 0; sid < LatencyTracker::COUNT; ++sid){
+		const LatencyHistogram & histogram = _latency.histogram(LatencyTracker::Stage(sid));
+		std::cout << "[INFO]: Latency " << LatencyTracker::stageNames[sid] << ": p50 " << histogram.percentile(0.5) << "ms, p95 " << histogram.percentile(0.95) << "ms, p99 " << histogram.percentile(0.99) << "ms over " << histogram.count() << " notes." << std::endl;
+	}
+	if(!_liveReportPath.empty()){
+		_latency.save(_liveReportPath);
+	}
 }
 
 SystemAction Viewer::draw(float currentTime) {
 
+	// Previous frames might have been completed by the GPU.
+	_latency.poll();
+
+	// Stop timed live sessions.
+	if(_liveplay && _liveDuration > 0.0f && (float(glfwGetTime()) - _liveStart) >= _liveDuration){
+		reportLiveSession();
+		_liveDuration = 0.0f;
+		return SystemAction::QUIT;
+	}
+
 	if(_recorder.isRecording()){
 		_timer = _recorder.currentTime();
 
@@ -227,12 +278,28 @@ SystemAction Viewer::draw(float currentTime) {
 	return action;
 }
 
+void Viewer::framePresented(){
+	_latency.present();
+}
+
 void Viewer::drawScene(bool transparentBG){
 
+	// Live scenes only keep notes that can be visible on the GPU, a note can be on screen up to two units away from the current time.
+	std::shared_ptr<MIDISceneLive> liveScene = std::dynamic_pointer_cast<MIDISceneLive>(_scene);
+	if(liveScene){
+		liveScene->setVisibleDuration(2.0f / _state.scale);
+	}
 	// Update active notes listing.
+	const double updateStart = MIDIInputQueue::now();
 	_scene->updatesActiveNotes(_state.scrollSpeed * _timer, _state.scrollSpeed, _state.filter);
+	// Track the cost of live updates and the latency of live notes.
+	if(_liveplay && liveScene){
+		_liveUpdateTimes.add((MIDIInputQueue::now() - updateStart) * 1000.0);
+		_latency.consume(liveScene->noteArrivals());
+	}
 	// Let renderer update GPU data if needed.
 	_renderer.upload(_scene);
+	_latency.reach(LatencyTracker::UPLOADED);
 
 	const glm::vec2 invSizeFb = 1.0f / glm::vec2(_renderFramebuffer->_width, _renderFramebuffer->_height);
 
@@ -293,7 +360,7 @@ void Viewer::blurPrepass() {
 	_passthrough.draw(_blurFramebuffer1->textureId(), _timer);
 	if (_state.showParticles) {
 		// Draw the new particles.
-		_renderer.drawParticles(_scene, _timer, invSizeB, _state.particles, true);
+		_renderer.drawParticles(invSizeB, _state.particles, true);
 	}
 	if (_state.showBlurNotes) {
 		// Draw the notes.
@@ -344,7 +411,7 @@ void Viewer::drawBlur(const glm::vec2 &) {
 }
 
 void Viewer::drawParticles(const glm::vec2 & invSize) {
-	_renderer.drawParticles(_scene, _timer, invSize, _state.particles, false);
+	_renderer.drawParticles(invSize, _state.particles, false);
 }
 
 void Viewer::drawScore(const glm::vec2 & invSize) {
@@ -514,6 +581,29 @@ SystemAction Viewer::drawGUI(const float currentTime) {
 			}
 			ImGui::helpTooltip(s_max_key_dsc);
 
+			if(_liveplay){
+				ImGui::BeginDisabled();
+			}
+			if(ImGui::Combo("Overlaps", (int*)&_state.notesPairing, "Restart\0First in, first out\0Last in, first out\0\0")){
+				// Reload the current file with the new pairing.
+				std::shared_ptr<MIDISceneFile> fileScene = std::dynamic_pointer_cast<MIDISceneFile>(_scene);
+				if(fileScene){
+					const std::string path = fileScene->filePath();
+					loadFile(path);
+				}
+			}
+			if(_liveplay){
+				ImGui::EndDisabled();
+				if(ImGui::IsItemHovered(ImGuiHoveredFlags_AllowWhenDisabled)){
+					ImGui::SetTooltip("Not available in liveplay");
+				}
+			} else {
+				ImGui::helpTooltip(s_notes_pairing_dsc);
+			}
+			ImGuiSameLine(COLUMN_SIZE);
+			ImGui::Checkbox("Progressive load", &_state.loadStreaming);
+			ImGui::helpTooltip(s_load_streaming_dsc);
+
 			if (ImGui::InputFloat("Preroll", &_state.prerollTime, 0.1f, 1.0f, "%.1fs")) {
 				reset();
 			}
@@ -555,6 +645,18 @@ SystemAction Viewer::drawGUI(const float currentTime) {
 				ImGui::helpTooltip(s_scroll_reverse_dsc);
 			}
 
+			if(_liveplay){
+				ImGuiPushItemWidth(100);
+				if(ImGui::InputFloat("Live history", &_state.liveHistory, 10.0f, 60.0f, "%.0fs")){
+					_state.liveHistory = glm::clamp(_state.liveHistory, 1.0f, 86400.0f);
+					std::shared_ptr<MIDISceneLive> liveScene = std::dynamic_pointer_cast<MIDISceneLive>(_scene);
+					if(liveScene){
+						liveScene->setHistoryDuration(_state.liveHistory);
+					}
+				}
+				ImGui::helpTooltip(s_live_history_dsc);
+				ImGui::PopItemWidth();
+			}
 		}
 
 		if(ImGui::CollapsingHeader("Notes##HEADER")){
@@ -603,6 +705,43 @@ SystemAction Viewer::drawGUI(const float currentTime) {
 			ImGui::TextDisabled("(press D to hide)");
 			ImGui::Text("%.1f FPS / %.1f ms", ImGui::GetIO().Framerate, ImGui::GetIO().DeltaTime * 1000.0f);
 			ImGui::Text("Render size: %dx%d, screen size: %dx%d", _renderFramebuffer->_width, _renderFramebuffer->_height, _camera.screenSize()[0], _camera.screenSize()[1]);
+			ImGui::Text("Particle bursts: %zu/%zu running, %llu replaced", _scene->getRunningParticles().size(), _scene->getParticles().size(), (unsigned long long)_scene->getEvictedParticles());
+			std::shared_ptr<MIDISceneLive> liveScene = std::dynamic_pointer_cast<MIDISceneLive>(_scene);
+			if(liveScene){
+				const MIDIInputQueue::Stats stats = liveScene->inputStats();
+				ImGui::Text("MIDI input: %llu messages, %llu dropped, %llu too long", (unsigned long long)stats.received, (unsigned long long)stats.dropped, (unsigned long long)stats.oversized);
+				ImGui::Text("MIDI queue: %zu/%zu at most", stats.peak, stats.capacity);
+				ImGui::Text("Live notes: %d in %zu pages, %zu on GPU", liveScene->notesCount(), liveScene->pagesCount(), liveScene->residentPagesCount());
+
+				// Latency from the arrival of notes to each step of the frames displaying them.
+				for(int sid = 0; sid < LatencyTracker::COUNT; ++sid){
+					const LatencyHistogram & histogram = _latency.histogram(LatencyTracker::Stage(sid));
+					ImGui::Text("Latency %-9s p50 %5.1fms, p95 %5.1fms, p99 %5.1fms (%llu notes)", LatencyTracker::stageNames[sid].c_str(), histogram.percentile(0.5), histogram.percentile(0.95), histogram.percentile(0.99), (unsigned long long)histogram.count());
+				}
+				const MIDISceneLive::TimingStats & timing = liveScene->timingStats();
+				ImGui::Text("Timing jitter      p50 %5.1fms, p99 %5.1fms, max %5.1fms", timing.jitter.percentile(0.5), timing.jitter.percentile(0.99), timing.jitter.max());
+				ImGui::Text("Frame offset       p50 %5.1fms, p99 %5.1fms, max %5.1fms", timing.frameOffsets.percentile(0.5), timing.frameOffsets.percentile(0.99), timing.frameOffsets.max());
+				const LatencyHistogram & completed = _latency.histogram(LatencyTracker::COMPLETED);
+				std::array<float, 50> latencies;
+				for(size_t lid = 0; lid < latencies.size(); ++lid){
+					latencies[lid] = float(completed.countInRange(double(lid), double(lid + 1)));
+				}
+				ImGui::PlotHistogram("##Latency", latencies.data(), int(latencies.size()), 0, "Completed, 0-50ms", 0.0f, FLT_MAX, ImVec2(0, 60));
+				if(ImGui::Button("Export latency...")){
+					char* savePath = nullptr;
+					int res = sr_gui_ask_save_file("Save latency statistics", "", "csv", &savePath);
+					System::forceLocale();
+					if(res == SR_GUI_VALIDATED && savePath){
+						_latency.save(std::string(savePath));
+					}
+					free(savePath);
+				}
+				ImGuiSameLine();
+				if(ImGui::Button("Reset latency")){
+					_latency.clear();
+					liveScene->clearTimingStats();
+				}
+			}
 			if (ImGui::Button("Print MIDI content to console")) {
 				_scene->print();
 			}
@@ -1023,6 +1162,13 @@ void Viewer::showParticleOptions(){
 	ImGuiPushItemWidth(100);
 	ImGui::SliderPercent("Turbulences", &_state.particles.turbulenceStrength, 0.01f, 8.0f);
 	ImGui::helpTooltip(s_particles_turbulences_dsc);
+	ImGuiSameLine(COLUMN_SIZE);
+
+	if (ImGui::InputInt("Bursts", &_state.particles.systems, 16, 256)) {
+		_state.particles.systems = glm::clamp(_state.particles.systems, 1, 16384);
+		_scene->setParticlesCapacity(_state.particles.systems);
+	}
+	ImGui::helpTooltip(s_particles_systems_dsc);
 	ImGui::PopItemWidth();
 
 	ImGui::PopID();
@@ -1397,13 +1543,13 @@ void Viewer::showDevices(){
 		ImGuiSameLine();
 
 		if(ImGui::SmallButton("start virtual device")){
-			_scene = std::make_shared<MIDISceneLive>(-1, _verbose);
+			_scene = std::make_shared<MIDISceneLive>(std::make_unique<MIDIDeviceSource>(-1), _journalPath, _verbose);
 			starting = true;
 		}
 		ImGui::helpTooltip("Act as a virtual device (via JACK)\nother MIDI elements can connect to");
 		ImGui::Separator();
 
-		const auto & devices = MIDISceneLive::availablePorts();
+		const auto & devices = MIDIDeviceSource::availablePorts();
 		for(int i = 0; i < devices.size(); ++i){
 			ImGui::RadioButton(devices[i].c_str(), &_selectedPort, i);
 		}
@@ -1421,7 +1567,7 @@ void Viewer::showDevices(){
 		if(!devices.empty()){
 			ImGuiSameLine(EXPORT_COLUMN_SIZE);
 			if(ImGui::Button("Start", buttonSize)){
-				_scene = std::make_shared<MIDISceneLive>(_selectedPort, _verbose);
+				_scene = std::make_shared<MIDISceneLive>(std::make_unique<MIDIDeviceSource>(_selectedPort), _journalPath, _verbose);
 				starting = true;
 			}
 		}
@@ -1449,19 +1595,24 @@ void Viewer::showVisibility(){
 		ImGui::Separator();
 		ImGuiPushItemWidth(35);
 		const size_t trackCount = _state.filter.tracks.size();
+		// Only tracks that can be hidden are listed.
+		const size_t shownCount = (std::min)(trackCount, size_t(MAX_TRACK_COUNT));
 		const std::string tenPrefix = trackCount < 10 ? "" : "0";
-		for(size_t cid = 0; cid < trackCount; ++cid){
+		for(size_t cid = 0; cid < shownCount; ++cid){
 			const std::string nameC = (cid < 10 ? tenPrefix : "") + std::to_string(cid);
 			bool val = _state.filter.tracks[cid];
 			shouldUpdate = ImGui::Checkbox(nameC.c_str(), &val) || shouldUpdate;
 			if(shouldUpdate){
 				_state.filter.tracks[cid] = val;
 			}
-			if((cid % 4 != 3) && (cid != (trackCount-1))){
+			if((cid % 4 != 3) && (cid != (shownCount-1))){
 				ImGuiSameLine();
 			}
 		}
 		ImGui::PopItemWidth();
+		if(trackCount > MAX_TRACK_COUNT){
+			ImGui::TextDisabled("Tracks past %d are always visible.", MAX_TRACK_COUNT);
+		}
 
 		// Do 4x4 columns of checkboxes
 		ImGui::Text("Channels");
@@ -2112,6 +2263,12 @@ void Viewer::applyAllSettings() {
 	_renderer.setKeyboardSizeAndFadeout(_state.keyboard.size, _state.notes.fadeOut);
 	_renderer.setMinorEdgesAndHeight(_state.keyboard.minorEdges, _state.keyboard.minorHeight);
 	_renderer.setOrientation(_state.horizontalScroll);
+	_scene->setParticlesCapacity(_state.particles.systems);
+
+	std::shared_ptr<MIDISceneLive> liveScene = std::dynamic_pointer_cast<MIDISceneLive>(_scene);
+	if(liveScene){
+		liveScene->setHistoryDuration(_state.liveHistory);
+	}
 
 	updateMinMaxKeys();
 
@@ -2133,6 +2290,7 @@ void Viewer::clean() {
 
 	// Clean objects.
 	_renderer.clean();
+	_latency.clean();
 	_blurringScreen.clean();
 	_passthrough.clean();
 	_backgroundTexture.clean();
@@ -2211,6 +2369,7 @@ void Viewer::reset() {
 }
 
 void Viewer::setState(const State & state){
+	const bool reloadFile = state.notesPairing != _state.notesPairing || state.loadStreaming != _state.loadStreaming;
 	_state = state;
 	_state.setOptions.rebuild();
 	_backupState = _state;
@@ -2228,6 +2387,12 @@ void Viewer::setState(const State & state){
 
 	// Update split notes.
 	if(_scene){
+		// Loading options have changed, reload the current file.
+		std::shared_ptr<MIDISceneFile> fileScene = std::dynamic_pointer_cast<MIDISceneFile>(_scene);
+		if(reloadFile && fileScene){
+			const std::string path = fileScene->filePath();
+			loadFile(path);
+		}
 		_scene->updateSetsAndVisibleNotes(_state.setOptions, _state.filter);
 	}
 	applyAllSettings();
@@ -2313,6 +2478,8 @@ bool Viewer::startDirectRecording(const Export& exporting, const glm::vec2 & siz
 }
 
 void Viewer::startRecording(){
+	// The full duration is needed.
+	_scene->finishLoading();
 	// We need to provide some information for the recorder to start.
 	_recorder.prepare(_state.prerollTime, float(_scene->duration()), _state.scrollSpeed);
 
@@ -8,12 +8,14 @@
 #include "Framebuffer.h"
 #include "camera/Camera.h"
 #include "scene/MIDIScene.h"
+#include "../midi/MIDIInputSource.h"
 #include "ScreenQuad.h"
 
 #include "../helpers/Recorder.h"
 
 #include "State.h"
 #include "Renderer.h"
+#include "LatencyTracker.h"
 
 #define DEBUG_SPEED (1.0f)
 
@@ -41,10 +43,19 @@ public:
 
 	bool connectDevice(const std::string & deviceName);
 
+	/// Start a live session receiving messages from the source, immediately playing if requested.
+	void connectSource(std::unique_ptr<MIDIInputSource> source, bool play);
+
+	/// Quit after a live session has lasted the given duration, reporting statistics.
+	void setLiveDuration(float duration, const std::string & reportPath);
+
 	void setState(const State & state);
 	
 	/// Draw function
 	SystemAction draw(const float currentTime);
+
+	/// Notify that the frame has been presented on screen.
+	void framePresented();
 	
 	/// Clean function
 	void clean();
@@ -153,6 +164,9 @@ private:
 	
 	void reset();
 
+	/// Print statistics of the current live session, and save them if requested.
+	void reportLiveSession();
+
 	void startRecording();
 
 	void updateSizes();
@@ -179,6 +193,8 @@ private:
 	bool _verbose = false;
 
 	Renderer _renderer;
+	LatencyTracker _latency;
+	LatencyHistogram _liveUpdateTimes; ///< CPU time of live scene updates, in milliseconds.
 	Recorder _recorder;
 	Camera _camera;
 	
@@ -208,4 +224,9 @@ private:
 	bool _liveplay = false;
 	bool _useTransparency = false;
 	const bool _supportTransparency;
+	std::string _cachePath; ///< Scene cache directory, empty if disabled.
+	std::string _journalPath; ///< Live sessions journal directory, empty if disabled.
+	std::string _liveReportPath;
+	float _liveDuration = 0.0f;
+	float _liveStart = 0.0f;
 };
@@ -18,7 +18,8 @@ MIDIScene::MIDIScene(){
 	// Prepare actives notes array.
 	_actives.fill(-1);
 	// Particle systems pool.
-	_particles = std::vector<Particles>(256);
+	_particles = std::vector<Particles>(PARTICLES_DEFAULT_CAPACITY);
+	resetParticles();
 	_notes = {GPUNote()};
 }
 
@@ -28,6 +29,95 @@ void MIDIScene::resetParticles() {
 		particle.set = -1;
 		particle.duration = particle.start = particle.elapsed = 0.0f;
 	}
+	_runningParticles.clear();
+	_freeParticles.resize(_particles.size());
+	// Hand out the first particle systems first.
+	for(size_t pid = 0; pid < _particles.size(); ++pid){
+		_freeParticles[pid] = int(_particles.size() - 1 - pid);
+	}
+}
+
+void MIDIScene::setParticlesCapacity(int capacity){
+	const size_t newCapacity = size_t((std::max)(capacity, 1));
+	if(newCapacity == _particles.size()){
+		return;
+	}
+	// Keep the newest running systems, packed at the beginning of the new pool.
+	const size_t keptCount = (std::min)(_runningParticles.size(), newCapacity);
+	const size_t firstKept = _runningParticles.size() - keptCount;
+	std::vector<Particles> particles(newCapacity);
+	for(size_t rid = 0; rid < keptCount; ++rid){
+		particles[rid] = _particles[_runningParticles[firstKept + rid]];
+	}
+	_evictedParticles += firstKept;
+	_particles.swap(particles);
+
+	_runningParticles.resize(keptCount);
+	for(size_t rid = 0; rid < keptCount; ++rid){
+		_runningParticles[rid] = int(rid);
+	}
+	// Hand out the first free systems first.
+	_freeParticles.clear();
+	for(size_t pid = newCapacity; pid > keptCount; --pid){
+		_freeParticles.push_back(int(pid - 1));
+	}
+}
+
+void MIDIScene::emitParticle(int note, int set, float start, float duration){
+	int pid = -1;
+	if(!_freeParticles.empty()){
+		pid = _freeParticles.back();
+		_freeParticles.pop_back();
+	} else {
+		// Replace the oldest system.
+		pid = _runningParticles.front();
+		_runningParticles.pop_front();
+		++_evictedParticles;
+	}
+	_runningParticles.push_back(pid);
+
+	auto & particle = _particles[pid];
+	particle.duration = duration;
+	particle.start = start;
+	particle.note = note;
+	particle.set = set;
+	particle.elapsed = 0.0f;
+}
+
+void MIDIScene::updateParticles(double time, double speed){
+	// Compact the running systems in place, preserving their age order.
+	size_t keptCount = 0;
+	for(size_t rid = 0; rid < _runningParticles.size(); ++rid){
+		const int pid = _runningParticles[rid];
+		auto & particle = _particles[pid];
+		// Give a bit of a head start to the animation.
+		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
+		// Disable particles that shouldn't be visible at the current time.
+		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
+			particle.note = -1;
+			particle.set = -1;
+			particle.duration = particle.start = particle.elapsed = 0.0f;
+			_freeParticles.push_back(pid);
+			continue;
+		}
+		_runningParticles[keptCount] = pid;
+		++keptCount;
+	}
+	_runningParticles.resize(keptCount);
+}
+
+uint32_t MIDIScene::packAttributes(int key, int channel, int track, int listSet){
+	return uint32_t(key & 0x7F) | (uint32_t(channel & 0xF) << 7) | (uint32_t(listSet & 0xF) << 11) | (uint32_t(track & 0xFFFF) << 15);
+}
+
+void MIDIScene::updateFilter(const SetOptions & options, const FilterOptions& filter){
+	_filter.setMode = int(options.mode);
+	for(int key = 0; key < 128; ++key){
+		_filter.keySets[key] = options.apply(key, 0, 0, 0.0);
+	}
+	_filter.hiddenChannels = filter.hiddenChannelsMask();
+	filter.hiddenTracksMask(_filter.hiddenTracks);
+	_dirtyFilter = true;
 }
 
 void MIDIScene::updateSetsAndVisibleNotes(const SetOptions & options, const FilterOptions& filter){
@@ -39,6 +129,9 @@ void MIDIScene::updateVisibleNotes( const FilterOptions& filter ){
 void MIDIScene::updatesActiveNotes(double time, double speed, const FilterOptions& filter ){
 }
 
+void MIDIScene::finishLoading(){
+}
+
 double MIDIScene::duration() const {
 	return 0.0;
 }
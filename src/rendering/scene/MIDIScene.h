@@ -5,8 +5,12 @@
 #include "../State.h"
 #include "../../helpers/ProgramUtilities.h"
 
+#include <deque>
 #include <fstream>
 
+// Particle systems available before the capacity is set.
+#define PARTICLES_DEFAULT_CAPACITY 256
+
 class MIDIScene {
 
 public:
@@ -31,20 +35,37 @@ public:
 		float start = 0.0f;
 		float duration = 0.0f;
 		float isMinor = 0.0f;
-		float set = 0.0f;
+		uint32_t attributes = 0; ///< Key, channel, list set and track, see packAttributes.
+	};
+
+	// Set assignment and visibility of notes, resolved in the notes shader.
+	struct GPUFilter {
+		int setMode = int(SetMode::CHANNEL);
+		std::array<int, 128> keySets{}; ///< Set of each key, for modes only based on the key.
+		int hiddenChannels = 0; ///< One bit per channel.
+		std::array<int, TRACKS_MASK_SIZE> hiddenTracks{}; ///< One bit per track.
 	};
 
+	/// Key on 7 bits, channel and set on 4 bits, track on 16 bits.
+	static uint32_t packAttributes(int key, int channel, int track, int listSet);
+
 
 	MIDIScene();
 
 	void resetParticles();
 
+	/// Resize the particle systems pool, keeping the most recent running systems.
+	void setParticlesCapacity(int capacity);
+
 	virtual void updateSetsAndVisibleNotes( const SetOptions& options, const FilterOptions& filter );
 
 	virtual void updateVisibleNotes( const FilterOptions& filter);
 
 	virtual void updatesActiveNotes(double time, double speed, const FilterOptions& filter);
 
+	/// Block until all notes are available, for scenes loaded progressively.
+	virtual void finishLoading();
+
 	virtual double duration() const;
 
 	virtual double secondsPerMeasure() const;
@@ -67,6 +88,12 @@ public:
 
 	const std::vector<Particles>& getParticles() const { return _particles; }
 
+	/// Indices of the running particle systems, from oldest to newest.
+	const std::deque<int>& getRunningParticles() const { return _runningParticles; }
+
+	/// Number of particle systems replaced by newer ones because the pool was full.
+	uint64_t getEvictedParticles() const { return _evictedParticles; }
+
 	const std::vector<GPUNote>& getNotes() const { return _notes; };
 
 	int getEffectiveNotesCount() const { return _effectiveNotesCount; }
@@ -75,16 +102,37 @@ public:
 
 	void setUpToDate() { _dirtyNotes = false; _dirtyNotesRange = {0, 0}; }
 
+	const GPUFilter& getFilter() const { return _filter; }
+
+	bool dirtyFilter() const { return _dirtyFilter; }
+
+	void setFilterUpToDate() { _dirtyFilter = false; }
+
 protected:
 
+	/// Update the sets and visibility parameters used by the notes shader.
+	void updateFilter(const SetOptions& options, const FilterOptions& filter);
+
+	/// Start a particle system for a note, replacing the oldest running one if the pool is full.
+	void emitParticle(int note, int set, float start, float duration);
+
+	/// Update the lifetime of running particle systems, and release finished ones.
+	void updateParticles(double time, double speed);
+
 	std::vector<GPUNote> _notes;
 	std::array<int, 128> _actives;
 	std::vector<Particles> _particles;
+	std::vector<int> _freeParticles; ///< Available particle systems.
+	std::deque<int> _runningParticles; ///< Particle systems in use, from oldest to newest.
+	uint64_t _evictedParticles = 0;
 	Pedals _pedals;
 	int _effectiveNotesCount = 0;
 
+	GPUFilter _filter;
+
 	glm::ivec2 _dirtyNotesRange{0,0};
 	bool _dirtyNotes = true;
+	bool _dirtyFilter = true;
 	// Active keys, particles and pedals are always dirty.
 
 };
@@ -9,6 +9,8 @@
 #include "../../helpers/ResourcesManager.h"
 
 #include "MIDISceneFile.h"
+#include "../../midi/MIDIBuffer.h"
+#include "../../midi/MIDIStream.h"
 
 #ifdef _WIN32
 #undef MIN
@@ -17,59 +19,135 @@
 
 MIDISceneFile::~MIDISceneFile(){}
 
-MIDISceneFile::MIDISceneFile(const std::string & midiFilePath, const SetOptions & options, const FilterOptions& filter) : MIDIScene() {
+MIDISceneFile::MIDISceneFile(const std::string & midiFilePath, const MIDILoadOptions & loadOptions, const SetOptions & options, const FilterOptions& filter) : MIDIScene() {
 
 	_filePath = midiFilePath;
 	// MIDI processing.
-	_midiFile = MIDIFile(_filePath);
+	if(loadOptions.streaming){
+		// A cached file is loaded faster than it would be streamed.
+		MIDIBuffer input;
+		if(!loadOptions.cacheDirectory.empty() && input.load(_filePath)){
+			_cachePath = MIDIFile::cachePath(input.span(), loadOptions);
+		}
+		if(_cachePath.empty() || !_midiFile.loadCache(_cachePath)){
+			// Notes will be received while playing.
+			_stream.reset(new MIDIStreamLoader(_filePath, loadOptions));
+			_midiFile = MIDIFile(_stream->header());
+		}
+	} else {
+		_midiFile = MIDIFile(_filePath, loadOptions);
+	}
+
+	_setOptions = options;
+	_midiFile.updateSets( options );
+	generateAllNotes();
+	updateVisibleNotes( filter );
+
+	if(!_stream){
+		std::cout << "[INFO]: Final track duration " << _midiFile.duration() << " sec." << std::endl;
+	}
+}
 
-	updateSetsAndVisibleNotes( options, filter );
+void MIDISceneFile::updateStream(){
+	if(!_stream){
+		return;
+	}
+	MIDIStreamBatch batch;
+	if(!_stream->poll(batch)){
+		return;
+	}
+	const size_t firstNote = size_t(_midiFile.notesCount());
+	_midiFile.appendStream(batch, _setOptions);
 
+	if(!batch.complete){
+		appendVisibleNotes(firstNote);
+		return;
+	}
+	// Build the final timelines and regenerate all notes data.
+	_stream.reset();
+	_midiFile.finalizeStream();
+	if(!_cachePath.empty()){
+		_midiFile.saveCache(_cachePath);
+	}
+	_cursor.valid = false;
+	generateAllNotes();
 	std::cout << "[INFO]: Final track duration " << _midiFile.duration() << " sec." << std::endl;
 }
 
+void MIDISceneFile::finishLoading(){
+	if(_stream){
+		_stream->wait();
+		updateStream();
+	}
+}
+
+void MIDISceneFile::generateNotes(size_t first){
+	// Convert notes directly from the file storage, majors then minors.
+	// Hidden notes are kept, the filter and sets are applied when rendering.
+	const NoteStore& notes = _midiFile.notes( 0 );
+	for( const bool minor : { false, true } ){
+		NoteStore::Cursor noteTimes( notes );
+		double start, duration;
+		for( size_t nid = first; nid < notes.size(); ++nid ){
+			const uint8_t key = notes.key( nid );
+			if( noteIsMinor[ key % 12 ] != minor ){
+				continue;
+			}
+			noteTimes.times( nid, start, duration );
+			GPUNote data;
+			data.note = float( ( key / 12 ) * 7 + noteShift[ key % 12 ] );
+			data.start = float( start );
+			data.duration = float( duration );
+			data.isMinor = minor ? 1.0f : 0.0f;
+			data.attributes = packAttributes( key, notes.channel( nid ), notes.track( nid ), notes.set( nid ) );
+			_notes.push_back( data );
+		}
+	}
+}
+
+void MIDISceneFile::appendVisibleNotes(size_t first){
+	const size_t firstNew = _notes.size();
+	generateNotes( first );
+	if( _notes.size() == firstNew ){
+		return;
+	}
+	// Only upload new notes, unless a full upload is already pending.
+	const glm::ivec2 range( int( firstNew ), int( _notes.size() ) - 1 );
+	if( !_dirtyNotes ){
+		_dirtyNotesRange = range;
+	} else if( _dirtyNotesRange.y != 0 ){
+		_dirtyNotesRange = glm::ivec2( ( std::min )( _dirtyNotesRange.x, range.x ), ( std::max )( _dirtyNotesRange.y, range.y ) );
+	}
+	_dirtyNotes = true;
+	assert( _notes.size() < ( 1u << 31 ) );
+	_effectiveNotesCount = int( _notes.size() );
+}
+
 
 void MIDISceneFile::updateSetsAndVisibleNotes( const SetOptions& options, const FilterOptions& filter )
 {
+	_setOptions = options;
 	_midiFile.updateSets( options );
+	// List sets depend on each note start, they are stored with the notes.
+	if( options.mode == SetMode::LIST ){
+		generateAllNotes();
+	}
 	updateVisibleNotes( filter );
 }
 
 void MIDISceneFile::updateVisibleNotes( const FilterOptions& filter )
+{
+	// Notes don't have to be regenerated.
+	updateFilter( _setOptions, filter );
+}
+
+void MIDISceneFile::generateAllNotes()
 {
 	// Generate note data for rendering.
-	std::vector<MIDINote> notesM;
-	_midiFile.getNotes( notesM, NoteType::MAJOR, filter, 0 );
-	std::vector<MIDINote> notesm;
-	_midiFile.getNotes( notesm, NoteType::MINOR, filter, 0 );
-
-	// Load notes shared data.
-	const size_t majorCount = notesM.size();
-	const size_t minorCount = notesm.size();
-	const size_t totalCount = majorCount + minorCount;
-	_notes.resize( totalCount );
-
-	for( size_t i = 0; i < majorCount; ++i )
-	{
-		const MIDINote& note = notesM[ i ];
-		GPUNote& data = _notes[ i ];
-		data.note = float( note.note );
-		data.start = float( note.start );
-		data.duration = float( note.duration );
-		data.isMinor = 0.0f;
-		data.set = float( note.set );
-	}
+	_notes.clear();
+	generateNotes( 0 );
+	const size_t totalCount = _notes.size();
 
-	for( size_t i = 0; i < minorCount; ++i )
-	{
-		const MIDINote& note = notesm[ i ];
-		GPUNote& data = _notes[ i + majorCount ];
-		data.note = float( note.note );
-		data.start = float( note.start );
-		data.duration = float( note.duration );
-		data.isMinor = 1.0f;
-		data.set = float( note.set );
-	}
 	// Upload to the GPU.
 	assert( totalCount < ( 1 << 31 ) );
 	_dirtyNotes = true;
@@ -78,45 +156,37 @@ void MIDISceneFile::updateVisibleNotes( const FilterOptions& filter )
 }
 
 void MIDISceneFile::updatesActiveNotes(double time, double speed, const FilterOptions& filter){
+	updateStream();
 	// Update the particle systems lifetimes.
-	for(auto & particle : _particles){
-		// Give a bit of a head start to the animation.
-		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
-		// Disable particles that shouldn't be visible at the current time.
-		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
-			particle.note = -1;
-			particle.set = -1;
-			particle.duration = particle.start = particle.elapsed = 0.0f;
-		}
-	}
-	// Get notes actives.
+	updateParticles(time, speed);
+	const double previousTime = _cursor.valid ? _cursor.time : time;
+	// Get notes actives, and notes triggered since the last frame.
 	auto actives = ActiveNotesArray();
-	_midiFile.getNotesActive(actives, time, filter, 0);
+	auto started = ActiveNotesArray();
+	_midiFile.getNotesActive(actives, started, _cursor, time, filter, 0);
 	for(int i = 0; i < 128; ++i){
-		const auto & note = actives[i];
-		_actives[i] = note.enabled ? note.set : -1;
+		const auto & note = started[i];
+		// Notes shorter than a frame are still displayed for one frame.
+		_actives[i] = actives[i].enabled ? actives[i].set : (note.enabled ? note.set : -1);
 		// Check if the note was triggered at this frame.
-		if(note.start > _previousTime && note.start <= time){
-			// Find an available particles system and update it with the note parameters.
-			for(auto & particle : _particles){
-				if(particle.note < 0){
-					// Update with new note parameter.
-					//const float durationTweak = 3.0f - note.velocity / 127.0f * 2.5f;
-					particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
-					particle.start = note.start;
-					particle.note = i;
-					particle.set = note.set;
-					particle.elapsed = 0.0f;
-					break;
-				}
-			}
+		if(note.enabled){
+			//const float durationTweak = 3.0f - note.velocity / 127.0f * 2.5f;
+			emitParticle(i, note.set, note.start, (std::max)(note.duration*2.0f, note.duration + 1.2f));
 		}
 	}
-	_previousTime = time;
 
 	// Update pedal state.
 	_pedals.damper = _pedals.sostenuto = _pedals.soft = _pedals.expression = 0.0f;
 	_midiFile.getPedalsActive(_pedals.damper, _pedals.sostenuto, _pedals.soft, _pedals.expression, time, 0);
+	// When playing, also show pedals pressed and released since the last frame.
+	if(time > previousTime){
+		Pedals frame;
+		_midiFile.getPedalsActive(frame.damper, frame.sostenuto, frame.soft, frame.expression, previousTime, time, 0);
+		_pedals.damper = _pedals.damper == 0.0f ? frame.damper : _pedals.damper;
+		_pedals.sostenuto = _pedals.sostenuto == 0.0f ? frame.sostenuto : _pedals.sostenuto;
+		_pedals.soft = _pedals.soft == 0.0f ? frame.soft : _pedals.soft;
+		_pedals.expression = _pedals.expression == 0.0f ? frame.expression : _pedals.expression;
+	}
 }
 
 double MIDISceneFile::duration() const {
@@ -140,14 +210,12 @@ void MIDISceneFile::print() const {
 }
 
 void MIDISceneFile::save(std::ofstream& file) const {
-	// Do it the dumb way.
-	std::ifstream input(_filePath);
-	if(input.is_open() && file.is_open()){
-		std::copy(std::istreambuf_iterator<char>(input),
-				  std::istreambuf_iterator<char>(),
-				  std::ostream_iterator<char>(file));
+	// Write the mapped file content in one go.
+	MIDIBuffer input;
+	if(input.load(_filePath) && file.is_open()){
+		const MIDISpan content = input.span();
+		file.write(reinterpret_cast<const char*>(content.data), std::streamsize(content.size));
 	}
-	input.close();
 }
 
 const std::string& MIDISceneFile::filePath() const {
@@ -6,11 +6,15 @@
 #include "../State.h"
 #include "MIDIScene.h"
 
+#include <memory>
+
+class MIDIStreamLoader;
+
 class MIDISceneFile : public MIDIScene {
 
 public:
 
-	MIDISceneFile(const std::string & midiFilePath, const SetOptions & options, const FilterOptions& filter );
+	MIDISceneFile(const std::string & midiFilePath, const MIDILoadOptions & loadOptions, const SetOptions & options, const FilterOptions& filter );
 
 	~MIDISceneFile();
 
@@ -20,6 +24,8 @@ public:
 
 	void updatesActiveNotes(double time, double speed, const FilterOptions& filter ) override;
 
+	void finishLoading() override;
+
 	double duration() const override;
 
 	double secondsPerMeasure() const override;
@@ -36,9 +42,25 @@ public:
 
 private:
 
+	/// Receive notes decoded by the stream loader since the last call.
+	void updateStream();
+
+	/// Convert notes starting at the given index to GPU data.
+	void generateNotes(size_t first);
+
+	/// Convert all notes to GPU data.
+	void generateAllNotes();
+
+	/// Append notes starting at the given index to the GPU data.
+	void appendVisibleNotes(size_t first);
+
 	MIDIFile _midiFile;
 	std::string _filePath;
-	double _previousTime = 0.0;
+	NoteCursor _cursor;
+
+	std::unique_ptr<MIDIStreamLoader> _stream; ///< Only set while the file is loaded progressively.
+	std::string _cachePath; ///< Where to save the file once streamed.
+	SetOptions _setOptions;
 	
 };
 
@@ -2,51 +2,53 @@
 #include <iostream>
 #include <vector>
 #include <algorithm>
+#include <cmath>
+#include <limits>
 #include <glm/gtc/matrix_transform.hpp>
 
 #include "../../helpers/ProgramUtilities.h"
 #include "../../helpers/ResourcesManager.h"
+#include "../../helpers/System.h"
 #include "../../midi/MIDIUtils.h"
 
 #include "MIDISceneLive.h"
 
-#include <libremidi/writer.hpp>
-
 
 #ifdef _WIN32
 #undef MIN
 #undef MAX
 #endif
 
-#define MAX_NOTES_IN_FLIGHT 8192
+// Pages resident at once before the GPU notes have to be reallocated.
+#define LIVE_RESIDENT_PAGES 8
+// Start of unused GPU notes, far from any visible time.
+#define LIVE_UNUSED_NOTE_START -1.0e6f
+// Messages that can be pending between two frames.
+#define MAX_MESSAGES_IN_FLIGHT 8192
 
 MIDISceneLive::~MIDISceneLive(){
-	shared().close_port();
+	// Stop the source before the queue is released.
+	_source->stop();
+	// The session ended normally, no need to keep the journal.
+	_journal.discard();
 }
 
-MIDISceneLive::MIDISceneLive(int port, bool verbose) : MIDIScene() {
+MIDISceneLive::MIDISceneLive(std::unique_ptr<MIDIInputSource> source, const std::string & journalDirectory, bool verbose) : MIDIScene(), _queue(MAX_MESSAGES_IN_FLIGHT), _source(std::move(source)) {
 	_verbose = verbose;
-	
-	// For now we use the same MIDI in instance for everything.
-	if(shared().is_port_open()){
-		shared().close_port();
-	}
-	if(port >= 0){
-		shared().open_port(port, "MIDIVisualizer input");
-		_deviceName = _availablePorts[port];
-	} else {
-		shared().open_virtual_port("MIDIVisualizer virtual input");
-		_deviceName = VIRTUAL_DEVICE_NAME;
-	}
-	shared().ignore_types(true, true, true);
+	_deviceName = _source->name();
+	_source->start(_queue);
 
 	_activeIds.fill(-1);
 	_activeRecording.fill(false);
-	_notes.resize(MAX_NOTES_IN_FLIGHT);
-	_notesInfos.resize(MAX_NOTES_IN_FLIGHT);
-	_allMessages.reserve(MAX_NOTES_IN_FLIGHT);
+	// Only visible pages are stored in the GPU notes.
+	_notes.clear();
+	_notes.reserve(LIVE_RESIDENT_PAGES * LIVE_PAGE_SIZE);
+	if(!journalDirectory.empty()){
+		// Scenes can be recreated in the same second.
+		_journal.open(journalDirectory + "live_" + System::timestamp() + "_" + std::to_string(_journalIndex++) + MIDI_JOURNAL_EXTENSION);
+	}
 	_secondsPerMeasure = computeMeasureDuration(_tempo, _signatureNum / _signatureDenom);
-	_pedalInfos[-10000.0f] = Pedals();
+	updateFilter(_currentSetOption, FilterOptions());
 
 	_dirtyNotes = true;
 	_dirtyNotesRange = {0, 0}; // Full array
@@ -55,55 +57,50 @@ MIDISceneLive::MIDISceneLive(int port, bool verbose) : MIDIScene() {
 void MIDISceneLive::updateSetsAndVisibleNotes(const SetOptions & options, const FilterOptions& filter){
 	_currentSetOption = options;
 	
-	for(size_t nid = 0; nid < _notesCount; ++nid){
-		auto & note = _notes[nid];
-		// Restore channel from note infos.
-		const int set = _currentSetOption.apply(int(note.note), _notesInfos[nid].channel, 0, note.start);
-		note.set = float(set);
+	for(NotePage & page : _pages){
+		for(size_t nid = 0; nid < page.notes.size(); ++nid){
+			ArchivedNote & note = page.notes[nid];
+			note.set = uint8_t(_currentSetOption.apply(note.key, note.channel, 0, note.start));
+			if(page.slot >= 0){
+				_notes[page.slot * LIVE_PAGE_SIZE + nid].attributes = packAttributes(note.key, note.channel, 0, note.set);
+			}
+		}
+	}
+	// List sets are stored with the notes, other modes only need the shader parameters.
+	if(options.mode == SetMode::LIST){
+		_dirtyNotes = true;
+		_dirtyNotesRange = {0, 0};
 	}
-
 	updateVisibleNotes(filter);
 }
 
 void MIDISceneLive::updateVisibleNotes(const FilterOptions& filter){
 	// Don't apply filter on live scenes. Assume the user won't want to hide what they are recording.
 	(void)filter;
-
-	// Just trigger a refresh of the full array.
-	_dirtyNotes = true;
-	_dirtyNotesRange = {0, 0};
+	updateFilter(_currentSetOption, FilterOptions());
 }
 
 void MIDISceneLive::updatesActiveNotes(double time, double speed, const FilterOptions& filter){
 	// Don't apply filter on live scenes. Assume the user won't want to hide what they are recording.
 	(void)filter;
 
-	int minUpdated = MAX_NOTES_IN_FLIGHT;
-	int maxUpdated = 0;
+	_noteArrivals.clear();
 
 	// If we are paused, just empty the queue.
 	if(_previousTime == time){
-		while(true){
-			auto message = shared().get_message();
-			if(message.size() == 0){
-				// End of the queue.
-				break;
-			}
-		}
+		_queue.clear();
+		_lastNoteArrival = -1.0;
+		// The visible window might still have changed.
+		updateResidentPages(time);
 		return;
 	}
+	// Intervals can't be compared across a jump back in time.
+	if(time < _previousTime){
+		_lastNoteArrival = -1.0;
+	}
 
 	// Update the particle systems lifetimes.
-	for(auto & particle : _particles){
-		// Give a bit of a head start to the animation.
-		particle.elapsed = (float(time) - particle.start + 0.25f) / (float(speed) * particle.duration);
-		// Disable particles that shouldn't be visible at the current time.
-		if(float(time) >= particle.start + particle.duration || float(time) < particle.start){
-			particle.note = -1;
-			particle.set = -1;
-			particle.duration = particle.start = particle.elapsed = 0.0f;
-		}
-	}
+	updateParticles(time, speed);
 
 	// Restore all active flags.
 	for(size_t nid = 0; nid < _actives.size(); ++nid){
@@ -116,35 +113,26 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed, const FilterOp
 			continue;
 		}
 		const int noteId = _activeIds[nid];
-		GPUNote & note = _notes[noteId];
+		ArchivedNote & note = archivedNote(noteId);
 		note.duration = (std::max)(float(time - double(note.start)), 0.0f);
-		_actives[nid] = int(note.set);
-		// Keep track of which region was modified.
-		minUpdated = (std::min)(minUpdated, noteId);
-		maxUpdated = (std::max)(maxUpdated, noteId);
+		updateNote(noteId);
+		_actives[nid] = note.set;
 	}
 
-	// Restore pedals to the last known state.
-	_pedals = Pedals();
-	auto nextBig = _pedalInfos.upper_bound(float(time));
-	if(nextBig != _pedalInfos.begin()){
-		_pedals = std::prev(nextBig)->second;
-	}
+	// Events are placed on the playback clock according to their arrival time, instead of the frame time.
+	// They can't be placed before the previous frame, that has already been displayed.
+	const double arrivalNow = MIDIInputQueue::now();
+	double eventTime = (std::min)(_previousTime, time);
 
 	// Process new events.
-	MIDIFrame frame;
-	frame.timestamp = time;
-	frame.messages.reserve(8);
-
-	while(true){
-		auto message = shared().get_message();
-		if(message.size() == 0){
-			// End of the queue.
-			break;
-		}
+	MIDIInputEvent event;
+	while(_queue.pop(event)){
+		const libremidi::message message(libremidi::midi_bytes(event.bytes.begin(), event.bytes.begin() + event.size), event.timestamp);
+		// Keep events ordered.
+		eventTime = clamp(time - (arrivalNow - event.timestamp) * speed, eventTime, time);
 
 		// Store message for saving.
-		frame.messages.push_back(message);
+		_journal.append(eventTime, event.bytes.data(), event.size);
 
 		const auto type = message.get_message_type();
 		// Handle note events.
@@ -160,53 +148,55 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed, const FilterOp
 			if(_activeRecording[note]){
 				_activeRecording[note] = false;
 				_actives[note] = -1;
-				// Duration has already been updated above.
+				// Stop at the event time, the duration was extended up to the frame time above.
+				ArchivedNote & activeNote = archivedNote(_activeIds[note]);
+				activeNote.duration = (std::max)(float(eventTime - double(activeNote.start)), 0.0f);
+				updateNote(_activeIds[note]);
+				completeNote(_activeIds[note]);
 			}
 
 			// If this is an on event with positive velocity, start a new note.
 			if(type == libremidi::message_type::NOTE_ON && velocity > 0){
 
-				const int index = _notesCount % MAX_NOTES_IN_FLIGHT;
-				// Get new note.
-				auto & newNote = _notes[index];
-				newNote.start = float(time);
-				newNote.duration = 0.0f;
-				newNote.note = note;
-				// Save the original channel.
-				_notesInfos[index].channel = message.get_channel();
+				const int index = _notesCount;
+				// Start a new page when the last one is full.
+				if(_pages.empty() || _pages.back().notes.size() == LIVE_PAGE_SIZE){
+					_pages.emplace_back();
+					_pages.back().notes.reserve(LIVE_PAGE_SIZE);
+					_pages.back().start = _pages.back().end = float(eventTime);
+					_pagesMaxEnd.push_back(_pagesMaxEnd.empty() ? float(eventTime) : (std::max)(_pagesMaxEnd.back(), float(eventTime)));
+					// The page is being recorded, it is visible.
+					makeResident(_pages.size() - 1);
+				}
+				// Get new note, with the original key and channel.
+				ArchivedNote newNote;
+				newNote.start = float(eventTime);
+				newNote.duration = float(time - eventTime);
+				newNote.key = uint8_t(note);
+				newNote.channel = uint8_t(message.get_channel());
 				// Compute set according to current setting.
-				const int set = _currentSetOption.apply(int(newNote.note), _notesInfos[index].channel, 0, newNote.start);
-				newNote.set = float(set);
-				_actives[note] = int(newNote.set);
+				const int set = _currentSetOption.apply(note, newNote.channel, 0, newNote.start);
+				newNote.set = uint8_t(set);
+				_pages.back().notes.push_back(newNote);
+				updateNote(index);
+
+				_actives[note] = set;
 				// Activate recording of the key.
 				_activeRecording[note] = true;
 				_activeIds[note] = index;
 
-				// Compute proper rendering note.
-				const bool isMin = noteIsMinor[note % 12];
-				const short shiftId = (note/12) * 7 + noteShift[note % 12];
-				newNote.isMinor = isMin ? 1.0f : 0.0f;
-				newNote.note = float(shiftId);
-				// Save original note.
-				_notesInfos[index].note = note;
-
-				// Keep track of which region was modified.
-				minUpdated = (std::min)(minUpdated, int(index));
-				maxUpdated = (std::max)(maxUpdated, int(index));
-
-				// Find an available particles system and update it with the note parameters.
-				for(auto & particle : _particles){
-					if(particle.note < 0){
-						// Update with new note parameter.
-						//const float durationTweak = 3.0f - float(velocity) / 127.0f * 2.5f;
-						particle.duration = 10.0f; // Fixed value.
-						particle.start = newNote.start;
-						particle.note = note;
-						particle.set = int(newNote.set);
-						particle.elapsed = 0.0f;
-						break;
-					}
+				_noteArrivals.push_back(event.timestamp);
+				// Compare the placement of consecutive notes with their arrival.
+				if(_lastNoteArrival >= 0.0){
+					const double expected = (event.timestamp - _lastNoteArrival) * speed;
+					_timing.jitter.add(std::abs((eventTime - _lastNoteStart) - expected) * 1000.0);
 				}
+				_timing.frameOffsets.add((arrivalNow - event.timestamp) * 1000.0);
+				_lastNoteArrival = event.timestamp;
+				_lastNoteStart = eventTime;
+
+				//const float durationTweak = 3.0f - float(velocity) / 127.0f * 2.5f;
+				emitParticle(note, set, newNote.start, 10.0f); // Fixed duration.
 
 				++_notesCount;
 			}
@@ -238,29 +228,14 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed, const FilterOp
 
 		} else if(type == libremidi::message_type::CONTROL_CHANGE){
 
-			// Handle pedal.
 			const int rawType = clamp<int>(message[1], 0, 127);
 
 			if(_verbose){
 				std::cout << "Control: " << rawType << "(" << message.timestamp << ")\n";
 			}
 
-			// Skip other CC.
-			if(rawType != 64 && rawType != 66 && rawType != 67 && rawType != 11){
-				continue;
-			}
-			const PedalType type = PedalType(rawType);
-
-			float & pedal = (type == DAMPER ? _pedals.damper : (type == SOSTENUTO ? _pedals.sostenuto : (type == SOFT ? _pedals.soft : _pedals.expression)));
-			// Stop the current pedal.
-			pedal = 0.0f;
-			// If non-zero velocity, enable pedal, normalized velocity.
-			const short val = clamp<short>(message[2], 0, 127);
-			if(val > 0){
-				pedal = float(val)/127.0f;
-			}
-			// Register new pedal event with updated state.
-			_pedalInfos[float(time)] = Pedals(_pedals);
+			// All controllers are kept, only pedals are displayed for now.
+			_controllers.append(float(eventTime), uint8_t(rawType), uint8_t(clamp<short>(message[2], 0, 127)));
 		} else {
 			if(_verbose){
 				std::cout << "Other (" << message.timestamp << ")\n";
@@ -268,56 +243,185 @@ void MIDISceneLive::updatesActiveNotes(double time, double speed, const FilterOp
 		}
 
 	}
-	// Insert all messages treated this frame in a new frame.
-	if(!frame.messages.empty()){
-		_allMessages.push_back(std::move(frame));
+	// Report messages lost since the last frame.
+	const MIDIInputQueue::Stats stats = _queue.stats();
+	const uint64_t drops = stats.dropped + stats.oversized;
+	if(drops != _reportedDrops){
+		std::cerr << "[WARNING]: Dropped " << (drops - _reportedDrops) << " MIDI messages (" << stats.dropped << " with a full queue, " << stats.oversized << " too long in total)." << std::endl;
+		_reportedDrops = drops;
+	}
+
+	// Persist all messages treated this frame.
+	_journal.flush();
+
+	// Restore pedals to the last known state.
+	const MIDIControllerTimeline::Values & controllers = _controllers.valuesAt(float(time));
+	_pedals.damper = float(controllers[DAMPER]) / 127.0f;
+	_pedals.sostenuto = float(controllers[SOSTENUTO]) / 127.0f;
+	_pedals.soft = float(controllers[SOFT]) / 127.0f;
+	_pedals.expression = float(controllers[EXPRESSION]) / 127.0f;
+	_controllers.discardBefore(float((std::max)(time, _maxTime)) - _historyDuration);
+
+	// Only keep the pages that can be visible at this time.
+	updateResidentPages(time);
+
+	// Completed notes are only visible again when playing over them. Notes started since the last frame
+	// but already ended are ignored, so only resident pages covering the current time have to be visited.
+	std::array<float, 128> activeStarts;
+	activeStarts.fill(std::numeric_limits<float>::lowest());
+	for(const size_t pid : _slotPages){
+		const NotePage & page = _pages[pid];
+		if(page.start <= float(time) && double(page.end) >= time){
+			updateCompletedNotes(page, time, activeStarts);
+		}
 	}
 
-	// Update completed notes.
-	for(size_t i = 0; i < _effectiveNotesCount; ++i){
-		const auto & noteId = _notesInfos[i];
+	// Update timings.
+	_previousTime = time;
+	_maxTime = (std::max)(time, _maxTime);
+}
+
+void MIDISceneLive::completeNote(int id){
+	const ArchivedNote & note = archivedNote(id);
+	const CompletedNote completed = {note.start, note.start + note.duration, id};
+	// Notes are completed in end order, unless recording after going back in time.
+	std::vector<CompletedNote> & pageCompleted = _pages[id / LIVE_PAGE_SIZE].completed;
+	const auto position = std::upper_bound(pageCompleted.begin(), pageCompleted.end(), completed, [](const CompletedNote& a, const CompletedNote& b){
+		return a.end < b.end;
+	});
+	pageCompleted.insert(position, completed);
+}
+
+void MIDISceneLive::updateCompletedNotes(const NotePage & page, double time, std::array<float, 128> & activeStarts){
+	// Notes ended before the current time can be skipped.
+	auto completed = std::lower_bound(page.completed.begin(), page.completed.end(), time, [](const CompletedNote& a, double value){
+		return double(a.end) < value;
+	});
+	for(; completed != page.completed.end(); ++completed){
+		if(completed->start > float(time)){
+			continue;
+		}
+		const ArchivedNote & noteId = archivedNote(completed->id);
 		// If the key is recording, no need to update _actives, skip.
-		if(_activeRecording[noteId.note]){
+		if(_activeRecording[noteId.key]){
 			continue;
 		}
-
-		auto& note = _notes[i];
 		// Ignore notes that ended at this frame.
-		float noteEnd = note.start + note.duration;
-		if(noteEnd > _previousTime && noteEnd <= time){
+		if(completed->end > _previousTime && completed->end <= time){
 			continue;
 		}
-		// Update for notes currently playins.
-		if(note.start <= time && note.start+note.duration >= time){
-			_actives[noteId.note] = int(note.set);
+		// Update for notes currently playing, the latest started one wins.
+		if(completed->start >= activeStarts[noteId.key]){
+			_actives[noteId.key] = noteId.set;
+			activeStarts[noteId.key] = completed->start;
 		}
 		// Detect notes that started at this frame.
-		if(note.start > _previousTime && note.start <= time){
-			// Find an available particles system and update it with the note parameters.
-			for(auto & particle : _particles){
-				if(particle.note < 0){
-					// Update with new note parameter.
-					particle.duration = (std::max)(note.duration*2.0f, note.duration + 1.2f);
-					particle.start = note.start;
-					particle.note = noteId.note;
-					particle.set = int(note.set);
-					particle.elapsed = 0.0f;
-					break;
-				}
+		if(completed->start > _previousTime){
+			const float duration = completed->end - completed->start;
+			emitParticle(noteId.key, noteId.set, completed->start, (std::max)(duration*2.0f, duration + 1.2f));
+		}
+	}
+}
+
+void MIDISceneLive::updateNote(int id){
+	const size_t pageId = size_t(id / LIVE_PAGE_SIZE);
+	NotePage & page = _pages[pageId];
+	const ArchivedNote & note = page.notes[id % LIVE_PAGE_SIZE];
+	page.start = (std::min)(page.start, note.start);
+	page.end = (std::max)(page.end, note.start + note.duration);
+	if(pageId > 0 && page.start < _pages[pageId - 1].start){
+		_pagesOrdered = false;
+	}
+	for(size_t pid = pageId; pid < _pagesMaxEnd.size() && _pagesMaxEnd[pid] < page.end; ++pid){
+		_pagesMaxEnd[pid] = page.end;
+	}
+	if(page.slot >= 0){
+		const int gpuId = page.slot * LIVE_PAGE_SIZE + (id % LIVE_PAGE_SIZE);
+		_notes[gpuId] = gpuNote(note);
+		markDirty(gpuId, gpuId);
+	}
+}
+
+void MIDISceneLive::updateResidentPages(double time){
+	const float windowStart = float(time) - _visibleDuration;
+	const float windowEnd = float(time) + _visibleDuration;
+	// Evict pages that left the window.
+	for(size_t sid = 0; sid < _slotPages.size();){
+		const NotePage & page = _pages[_slotPages[sid]];
+		if(page.end < windowStart || page.start > windowEnd){
+			// Another page is moved to this slot.
+			evict(sid);
+		} else {
+			++sid;
+		}
+	}
+	// Pages before the first one with a note ending in the window can be skipped.
+	size_t pid = size_t(std::lower_bound(_pagesMaxEnd.begin(), _pagesMaxEnd.end(), windowStart) - _pagesMaxEnd.begin());
+	for(; pid < _pages.size(); ++pid){
+		const NotePage & page = _pages[pid];
+		if(page.start > windowEnd){
+			if(_pagesOrdered){
+				break;
 			}
+			continue;
+		}
+		if(page.slot < 0 && page.end >= windowStart){
+			makeResident(pid);
 		}
 	}
+	_effectiveNotesCount = int(_slotPages.size()) * LIVE_PAGE_SIZE;
+}
+
+void MIDISceneLive::makeResident(size_t pageId){
+	NotePage & page = _pages[pageId];
+	page.slot = int(_slotPages.size());
+	_slotPages.push_back(pageId);
+	// The GPU notes never shrink, so that pages coming back don't trigger a reallocation.
+	const size_t first = size_t(page.slot) * LIVE_PAGE_SIZE;
+	if(_notes.size() < first + LIVE_PAGE_SIZE){
+		_notes.resize(first + LIVE_PAGE_SIZE);
+	}
+	GPUNote unused;
+	unused.start = LIVE_UNUSED_NOTE_START;
+	for(size_t nid = 0; nid < LIVE_PAGE_SIZE; ++nid){
+		_notes[first + nid] = nid < page.notes.size() ? gpuNote(page.notes[nid]) : unused;
+	}
+	markDirty(int(first), int(first + LIVE_PAGE_SIZE) - 1);
+}
 
-	// If we have indeed updated a note, trigger an upload.
-	if(minUpdated <= maxUpdated){
-		_dirtyNotes = true;
-		_dirtyNotesRange = {minUpdated, maxUpdated};
+void MIDISceneLive::evict(size_t slot){
+	_pages[_slotPages[slot]].slot = -1;
+	const size_t last = _slotPages.size() - 1;
+	if(slot != last){
+		// Keep resident pages packed at the beginning of the GPU notes.
+		const size_t movedPage = _slotPages[last];
+		_slotPages[slot] = movedPage;
+		_pages[movedPage].slot = int(slot);
+		std::copy(_notes.begin() + last * LIVE_PAGE_SIZE, _notes.begin() + (last + 1) * LIVE_PAGE_SIZE, _notes.begin() + slot * LIVE_PAGE_SIZE);
+		markDirty(int(slot * LIVE_PAGE_SIZE), int((slot + 1) * LIVE_PAGE_SIZE) - 1);
 	}
-	// Update range of notes to show.
-	_effectiveNotesCount = std::min(MAX_NOTES_IN_FLIGHT, _notesCount);
-	// Update timings.
-	_previousTime = time;
-	_maxTime = (std::max)(time, _maxTime);
+	_slotPages.pop_back();
+}
+
+void MIDISceneLive::markDirty(int first, int last){
+	// An empty range means that a full upload is already pending.
+	if(!_dirtyNotes){
+		_dirtyNotesRange = {first, last};
+	} else if(_dirtyNotesRange.y != 0){
+		_dirtyNotesRange = {(std::min)(_dirtyNotesRange.x, first), (std::max)(_dirtyNotesRange.y, last)};
+	}
+	_dirtyNotes = true;
+}
+
+MIDIScene::GPUNote MIDISceneLive::gpuNote(const ArchivedNote & note){
+	// Compute proper rendering note.
+	GPUNote gpuNote;
+	gpuNote.note = float((note.key / 12) * 7 + noteShift[note.key % 12]);
+	gpuNote.isMinor = noteIsMinor[note.key % 12] ? 1.0f : 0.0f;
+	gpuNote.start = note.start;
+	gpuNote.duration = note.duration;
+	gpuNote.attributes = packAttributes(note.key, note.channel, 0, note.set);
+	return gpuNote;
 }
 
 double MIDISceneLive::duration() const {
@@ -341,85 +445,31 @@ void MIDISceneLive::print() const {
 }
 
 void MIDISceneLive::save(std::ofstream& file) const {
-
-	const double quarterNotesPerSecond = 1000000.0 / double(_tempo);
-	const double unitsPerQuarterNote = 960.0;
-	const double unitsPerSecond = unitsPerQuarterNote * quarterNotesPerSecond;
-
 	if(_verbose){
-		std::cout << "Saving recording using " << unitsPerSecond << " units per second, containing " << _allMessages.size() << " messages." << std::endl;
-	}
-
-	// Make a copy of all messages and sort it.
-	std::vector<MIDIFrame> allMessages(_allMessages);
-	// Start by sorting the frames
-	std::sort(allMessages.begin(), allMessages.end(), [](const MIDIFrame& a, const MIDIFrame& b){
-		return a.timestamp < b.timestamp;
-	});
-
-	// For each frame, update all messages timestamp.
-	double currentTime = 0.0;
-
-	for(MIDIFrame& frame : allMessages){
-		// Skip empty frames (should not exist), don't udpate the timing.
-		if(frame.messages.empty()){
-			continue;
-		}
-		// First message should have a real delta to the last existing message.
-		frame.messages[0].timestamp = frame.timestamp - currentTime;
-		// All others are 0 as they happen at the same time.
-		const size_t messageCount = frame.messages.size();
-		for(size_t mid = 1; mid < messageCount; ++mid){
-			frame.messages[mid].timestamp = 0.0;
-		}
-		// If two consecutive frames have the same timestamp, all deltas of the second frame will be set to 0.
-		currentTime = frame.timestamp;
+		std::cout << "Saving recording containing " << _journal.messagesCount() << " messages." << std::endl;
 	}
+	_journal.write(file, _tempo, int(_signatureNum), int(_signatureDenom));
+}
 
-	// Start a file with one track.
-	libremidi::writer writer;
-	writer.ticksPerQuarterNote = int(unitsPerQuarterNote);
-	writer.tracks.resize(1);
+void MIDISceneLive::clearTimingStats(){
+	_timing.jitter.clear();
+	_timing.frameOffsets.clear();
+}
 
-	// Set an initial tempo/signature at t=0 so that the first 'real' message delta is correct.
-	writer.add_event(0, 0, libremidi::meta_events::tempo(_tempo));
-	writer.add_event(0, 0, libremidi::meta_events::time_signature(int(_signatureNum), int(_signatureDenom)));
-	writer.add_event(0, 0, libremidi::meta_events::key_signature(1, false));
+void MIDISceneLive::setHistoryDuration(float duration){
+	_historyDuration = duration;
+}
 
-	// Write all messages.
-	for(const MIDIFrame& frame : allMessages){
-		for(const libremidi::message& message : frame.messages){
-			writer.add_event(int(message.timestamp * unitsPerSecond), 0, message);
-		}
-	}
-	writer.write(file);
+void MIDISceneLive::setVisibleDuration(float duration){
+	_visibleDuration = duration;
 }
 
 const std::string& MIDISceneLive::deviceName() const {
 	return _deviceName;
 }
 
-libremidi::midi_in * MIDISceneLive::_sharedMIDIIn = nullptr;
-std::vector<std::string> MIDISceneLive::_availablePorts;
-int MIDISceneLive::_refreshIndex = 0;
+int MIDISceneLive::_journalIndex = 0;
 
-libremidi::midi_in & MIDISceneLive::shared(){
-	if(_sharedMIDIIn == nullptr){
-		_sharedMIDIIn = new libremidi::midi_in(libremidi::API::UNSPECIFIED, "MIDIVisualizer");
-	}
-	return *_sharedMIDIIn;
-}
-
-const std::vector<std::string> & MIDISceneLive::availablePorts(bool force){
-	if((_refreshIndex == 0) || force){
-		const int portCount = shared().get_port_count();
-		_availablePorts.resize(portCount);
-
-		for(int i = 0; i < portCount; ++i){
-			_availablePorts[i] = shared().get_port_name(i);
-		}
-	}
-	// Only update once every 15 frames.
-	_refreshIndex = (_refreshIndex + 1) % 15;
-	return _availablePorts;
+MIDIInputQueue::Stats MIDISceneLive::inputStats() const {
+	return _queue.stats();
 }
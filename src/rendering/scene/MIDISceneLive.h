@@ -3,19 +3,26 @@
 #include <gl3w/gl3w.h>
 #include <glm/glm.hpp>
 #include "../midi/MIDIBase.h"
+#include "../midi/MIDIInputQueue.h"
+#include "../midi/MIDIDeviceSource.h"
+#include "../midi/MIDIJournal.h"
+#include "../midi/MIDIControllerTimeline.h"
 #include "../State.h"
+#include "../LatencyTracker.h"
 #include "MIDIScene.h"
 
 #include <libremidi/libremidi.hpp>
-#include <map>
+#include <memory>
 
-#define VIRTUAL_DEVICE_NAME "VIRTUAL"
+// Notes archived and uploaded together.
+#define LIVE_PAGE_SIZE 1024
 
 class MIDISceneLive : public MIDIScene {
 
 public:
 
-	MIDISceneLive(int port, bool verbose);
+	/// Received messages are journaled in the directory if not empty.
+	MIDISceneLive(std::unique_ptr<MIDIInputSource> source, const std::string & journalDirectory, bool verbose);
 
 	~MIDISceneLive();
 
@@ -39,27 +46,98 @@ public:
 
 	const std::string& deviceName() const;
 
-	static const std::vector<std::string> & availablePorts(bool force = false);
+	/// Arrival times of the notes started during the last update, see MIDIInputQueue::now.
+	const std::vector<double> & noteArrivals() const { return _noteArrivals; }
+
+	/// Duration in seconds of the controllers history to keep.
+	void setHistoryDuration(float duration);
+
+	/// Longest duration between the current time and visible notes, in seconds.
+	void setVisibleDuration(float duration);
+
+	size_t pagesCount() const { return _pages.size(); }
+
+	size_t residentPagesCount() const { return _slotPages.size(); }
+
+	MIDIInputQueue::Stats inputStats() const;
+
+	/// Placement of received notes on the playback clock, in milliseconds.
+	struct TimingStats {
+		LatencyHistogram jitter; ///< Difference between the intervals separating consecutive notes on the playback and arrival clocks.
+		LatencyHistogram frameOffsets; ///< Time between the arrival of a note and the frame processing it.
+	};
+
+	const TimingStats & timingStats() const { return _timing; }
+
+	void clearTimingStats();
 	
 private:
 
-	struct NoteInfos {
-		short note;
-		short channel;
+	// Compact copy of a note, kept for the whole session.
+	struct ArchivedNote {
+		float start;
+		float duration;
+		uint8_t key;
+		uint8_t channel;
+		uint8_t set;
+	};
+
+	// A note that is not recording anymore.
+	struct CompletedNote {
+		float start;
+		float end;
+		int id;
 	};
 
-	struct MIDIFrame {
-		std::vector<libremidi::message> messages;
-		double timestamp;
+	// Consecutive received notes, uploaded together when they might be visible.
+	struct NotePage {
+		std::vector<ArchivedNote> notes;
+		std::vector<CompletedNote> completed; ///< Notes of the page that are not recording anymore, sorted by end.
+		float start = 0.0f; ///< Earliest note start.
+		float end = 0.0f; ///< Latest note end.
+		int slot = -1; ///< Position in the GPU notes, or -1 if not resident.
 	};
 
-	std::vector<NoteInfos> _notesInfos;
+	/// Add a note that stopped recording to the completed notes of its page.
+	void completeNote(int id);
+
+	/// Mark keys of completed notes playing at the given time, and emit particles for the ones started since the previous time.
+	void updateCompletedNotes(const NotePage & page, double time, std::array<float, 128> & activeStarts);
+
+	ArchivedNote & archivedNote(int id) { return _pages[id / LIVE_PAGE_SIZE].notes[id % LIVE_PAGE_SIZE]; }
+
+	/// Update the bounds of the page containing a modified note, and its GPU copy if resident.
+	void updateNote(int id);
+
+	/// Upload the pages intersecting the visible window, and evict the others.
+	void updateResidentPages(double time);
+
+	void makeResident(size_t pageId);
+
+	/// Free a slot, moving the last resident page in its place.
+	void evict(size_t slot);
+
+	/// Request upload of a range of GPU notes.
+	void markDirty(int first, int last);
+
+	static GPUNote gpuNote(const ArchivedNote & note);
+
+	std::vector<NotePage> _pages; ///< In recording order.
+	std::vector<float> _pagesMaxEnd; ///< Latest note end over each page and the ones before it.
+	std::vector<size_t> _slotPages; ///< Page stored in each slot of the GPU notes.
+	float _visibleDuration = 2.0f;
+	bool _pagesOrdered = true; ///< Page starts are increasing, until notes are recorded after going back in time.
 	std::array<int, 128> _activeIds;
 	std::array<bool, 128> _activeRecording;
-	std::map<float, Pedals> _pedalInfos;
-	std::vector<MIDIFrame> _allMessages;
+	MIDIControllerTimeline _controllers;
+	std::vector<double> _noteArrivals;
+	TimingStats _timing;
+	double _lastNoteArrival = -1.0; ///< On the arrival clock.
+	double _lastNoteStart = 0.0; ///< On the playback clock.
+	MIDIJournal _journal; ///< All received messages, for saving.
 
 	double _previousTime = 0.0;
+	float _historyDuration = 600.0f;
 	double _maxTime = 0.0;
 	double _signatureNum = 4.0;
 	double _signatureDenom = 4.0;
@@ -70,12 +148,12 @@ private:
 	SetOptions _currentSetOption;
 	std::string _deviceName;
 	bool _verbose = false;
+	uint64_t _reportedDrops = 0;
 
-	static libremidi::midi_in & shared();
+	MIDIInputQueue _queue; ///< Filled by the source thread.
+	std::unique_ptr<MIDIInputSource> _source;
 
-	static libremidi::midi_in * _sharedMIDIIn;
-	static std::vector<std::string> _availablePorts;
-	static int _refreshIndex;
+	static int _journalIndex;
 
 };
 
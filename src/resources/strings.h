@@ -36,6 +36,12 @@ constexpr const char* s_min_key_dsc 						= "Lowest key to display";
 constexpr const char* s_max_key_key 						= "max-key";
 constexpr const char* s_max_key_dsc 						= "Highest key to display";
 
+constexpr const char* s_notes_pairing_key 					= "notes-pairing";
+constexpr const char* s_notes_pairing_dsc 					= "How overlapping notes on the same key are paired, applied when loading a file";
+
+constexpr const char* s_load_streaming_key 					= "load-streaming";
+constexpr const char* s_load_streaming_dsc 					= "Load files progressively, playback can start while the end of the file is still being read";
+
 constexpr const char* s_smooth_key 							= "smooth";
 constexpr const char* s_smooth_dsc 							= "Apply anti-aliasing to smooth all lines";
 
@@ -54,6 +60,9 @@ constexpr const char* s_scroll_reverse_dsc 					= "Notes scroll from bottom to t
 constexpr const char* s_scroll_horizontal_key 				= "scroll-horizontal";
 constexpr const char* s_scroll_horizontal_dsc 				= "Notes scroll from right to left when enabled";
 
+constexpr const char* s_live_history_key 					= "live-history";
+constexpr const char* s_live_history_dsc 					= "Duration in seconds of the pedals and controllers history kept in live mode";
+
 constexpr const char* s_layers_key 							= "layers";
 constexpr const char* s_layers_dsc 							= "Active layers indices, from background to foreground";
 
@@ -144,6 +153,9 @@ constexpr const char* s_flashes_img_columns_dsc 			= "Number of columns in the f
 constexpr const char* s_particles_count_key 				= "particles-count";
 constexpr const char* s_particles_count_dsc 				= "Number of particles in each burst";
 
+constexpr const char* s_particles_systems_key 				= "particles-systems";
+constexpr const char* s_particles_systems_dsc 				= "Maximum number of bursts displayed at once, the oldest ones are replaced first";
+
 constexpr const char* s_particles_size_key 					= "particles-size";
 constexpr const char* s_particles_size_dsc 					= "Size of the particles";
 